@@ -12,21 +12,175 @@
 #include <vector>
 #include <map>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <ctime>
 #include <algorithm>
+#include <functional>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <filesystem>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <random>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+// The coroutine intake pipeline (the "async" subcommand) needs a C++20 build on Linux.
+#if defined(__cpp_impl_coroutine) && defined(__linux__)
+#define ZOO_ASYNC_INTAKE 1
+#include <coroutine>
+#include <optional>
+#include <utility>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+// Function to copy a string that is too long for an InlineString into the current overflow
+// arena (see StringArena, defined with the memory accounting below).
+const char* storeOverflowString(string_view value);
+
+// Fixed-size string for the short text fields of Animal. Up to Size - 1 bytes are stored
+// inline; a longer value is copied once to the overflow arena and the InlineString keeps a
+// pointer and length instead. Arena copies are never moved, so InlineStrings (and Animals)
+// can be copied and relocated with memcpy; they are freed with the arena that holds them.
+template <size_t Size>
+class InlineString {
+    static_assert(Size > sizeof(const char*) + sizeof(uint32_t) && Size < 256, "unsupported InlineString size");
+    static const unsigned char Overflow = 0xff;
+
+    char bytes[Size - 1];
+    unsigned char length = 0; // Inline length, or Overflow when the value lives in the arena.
+
+public:
+    InlineString() = default;
+    InlineString(string_view value) {
+        assign(value);
+    }
+    InlineString& operator=(string_view value) {
+        assign(value);
+        return *this;
+    }
+
+    void assign(string_view value) {
+        if (value.size() < Size) {
+            memcpy(bytes, value.data(), value.size());
+            length = static_cast<unsigned char>(value.size());
+            return;
+        }
+        const char* stored = storeOverflowString(value);
+        uint32_t size = static_cast<uint32_t>(value.size());
+        memcpy(bytes, &stored, sizeof(stored));
+        memcpy(bytes + sizeof(stored), &size, sizeof(size));
+        length = Overflow;
+    }
+
+    void append(string_view more) {
+        if (length != Overflow && length + more.size() < Size) {
+            memcpy(bytes + length, more.data(), more.size());
+            length = static_cast<unsigned char>(length + more.size());
+            return;
+        }
+        // Join in a stack buffer when possible; either way the result is stored once.
+        string_view current = view();
+        char joined[512];
+        if (current.size() + more.size() <= sizeof(joined)) {
+            memcpy(joined, current.data(), current.size());
+            memcpy(joined + current.size(), more.data(), more.size());
+            assign(string_view(joined, current.size() + more.size()));
+            return;
+        }
+        assign(string(current) + string(more));
+    }
+    InlineString& operator+=(char c) {
+        append(string_view(&c, 1));
+        return *this;
+    }
+
+    string_view view() const {
+        if (length != Overflow)
+            return string_view(bytes, length);
+        const char* stored;
+        uint32_t size;
+        memcpy(&stored, bytes, sizeof(stored));
+        memcpy(&size, bytes + sizeof(stored), sizeof(size));
+        return string_view(stored, size);
+    }
+    operator string_view() const {
+        return view();
+    }
+    string str() const {
+        return string(view());
+    }
+    size_t size() const {
+        return view().size();
+    }
+    bool empty() const {
+        return length == 0;
+    }
+    void clear() {
+        length = 0;
+    }
+    bool overflowed() const {
+        return length == Overflow;
+    }
+
+    friend bool operator==(const InlineString& a, string_view b) {
+        return a.view() == b;
+    }
+    friend bool operator==(string_view a, const InlineString& b) {
+        return a == b.view();
+    }
+    friend bool operator!=(const InlineString& a, string_view b) {
+        return a.view() != b;
+    }
+    friend ostream& operator<<(ostream& out, const InlineString& s) {
+        return out << s.view();
+    }
+};
+
 // Data structure to hold information about each animal.
+// Text fields are sized so typical values stay inline and a record fills two cache lines.
 struct Animal {
-    int age;            // Animal's age
-    string species;     // Animal's species (e.g., "Hyena", "Lion")
-    string birthSeason; // Description of the animal's birth season
-    string color;       // Color description of the animal
-    double weight;      // Animal's weight
-    string origin;      // Origin information (combined from two parts)
-    string name;        // Assigned name from the animal names file
+    uint64_t id = 0;                // Stable ID assigned at intake (0 for records written before IDs existed)
+    int age;                        // Animal's age
+    InlineString<24> species;       // Animal's species (e.g., "Hyena", "Lion")
+    InlineString<16> birthSeason;   // Description of the animal's birth season
+    InlineString<16> color;         // Color description of the animal
+    int64_t weight;                 // Animal's weight in hundredths of a pound (fixed point)
+    InlineString<32> origin;        // Origin information (combined from two parts)
+    InlineString<16> name;          // Assigned name from the animal names file
 };
+static_assert(sizeof(Animal) <= 128, "Animal should fit in two cache lines");
+static_assert(is_trivially_copyable<Animal>::value, "Animal should be relocatable with memcpy");
 
 // Helper function that removes any leading and trailing whitespace from a string.
 string trim(const string& s) {
@@ -37,14 +191,799 @@ string trim(const string& s) {
     return s.substr(start, end - start + 1);
 }
 
+// Allocation counting build mode (compile with -DZOO_COUNT_ALLOCATIONS).
+// Global operator new/delete are replaced with versions that count every heap allocation,
+// so benchmarks can check how many allocations a hot path makes per record.
+atomic<uint64_t> globalAllocationCount(0);
+
+#ifdef ZOO_COUNT_ALLOCATIONS
+void* countedAllocate(size_t size) {
+    globalAllocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size) { return countedAllocate(size); }
+void* operator new[](size_t size) { return countedAllocate(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    globalAllocationCount.fetch_add(1, memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    globalAllocationCount.fetch_add(1, memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+#endif
+
+// Returns true when the program was built with allocation counting.
+constexpr bool countingAllocations() {
+#ifdef ZOO_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Returns the number of heap allocations made by work (always 0 without ZOO_COUNT_ALLOCATIONS).
+uint64_t countAllocations(const function<void()>& work) {
+    uint64_t before = globalAllocationCount.load();
+    work();
+    return globalAllocationCount.load() - before;
+}
+
+// Event tracing for pipeline stages, exported in Chrome trace format (chrome://tracing, Perfetto).
+// Every thread records into its own fixed-size ring buffer, so recording takes no locks;
+// the mutex is only used the first time a thread records an event. When the ring is full
+// the oldest events are overwritten. Tracing is off unless enabled with --trace.
+struct TraceEvent {
+    const char* name;    // Must be a string literal (stored by pointer).
+    uint64_t startNanos;
+    uint64_t durationNanos;
+};
+
+struct TraceBuffer {
+    static const size_t capacity = 1 << 14;
+    uint32_t threadId = 0;
+    atomic<bool> inUse{false};
+    atomic<uint64_t> written{0};
+    TraceEvent events[capacity];
+};
+
+struct TraceRegistry {
+    atomic<bool> enabled{false};
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    mutex lock; // Guards buffers only.
+    vector<unique_ptr<TraceBuffer>> buffers;
+};
+
+TraceRegistry& traceRegistry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+// Returns the calling thread's trace buffer. Buffers of finished threads are reused,
+// so short-lived worker threads do not grow the registry.
+TraceBuffer& threadTraceBuffer() {
+    struct Holder {
+        TraceBuffer* buffer = nullptr;
+        ~Holder() {
+            if (buffer)
+                buffer->inUse = false;
+        }
+    };
+    thread_local Holder holder;
+    if (!holder.buffer) {
+        TraceRegistry& registry = traceRegistry();
+        lock_guard<mutex> guard(registry.lock);
+        for (auto& buffer : registry.buffers) {
+            if (!buffer->inUse) {
+                holder.buffer = buffer.get();
+                break;
+            }
+        }
+        if (!holder.buffer) {
+            registry.buffers.push_back(make_unique<TraceBuffer>());
+            holder.buffer = registry.buffers.back().get();
+            holder.buffer->threadId = static_cast<uint32_t>(registry.buffers.size());
+        }
+        holder.buffer->inUse = true;
+    }
+    return *holder.buffer;
+}
+
+uint64_t traceNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceRegistry().origin).count();
+}
+
+// Records one traced span from construction to destruction, e.g.
+//     TraceScope trace("parse chunk");
+struct TraceScope {
+    const char* name;
+    uint64_t start = 0;
+
+    explicit TraceScope(const char* name) : name(name) {
+        if (traceRegistry().enabled.load(memory_order_relaxed))
+            start = traceNow();
+        else
+            this->name = nullptr;
+    }
+
+    ~TraceScope() {
+        if (!name)
+            return;
+        TraceBuffer& buffer = threadTraceBuffer();
+        uint64_t slot = buffer.written.load(memory_order_relaxed);
+        buffer.events[slot % TraceBuffer::capacity] = {name, start, traceNow() - start};
+        buffer.written.store(slot + 1, memory_order_release);
+    }
+};
+
+// Function to write all recorded events as a Chrome trace JSON file.
+// Should be called once the traced work has finished.
+bool writeChromeTrace(const string& filename) {
+    ofstream file(filename);
+    if (!file) {
+        cerr << "Error opening file for writing: " << filename << endl;
+        return false;
+    }
+    TraceRegistry& registry = traceRegistry();
+    lock_guard<mutex> guard(registry.lock);
+    // Chrome expects microseconds; write them exactly as "<micros>.<3-digit nanos>" since
+    // default stream formatting rounds to 6 significant digits.
+    auto micros = [](uint64_t nanos) {
+        char fraction[4] = {static_cast<char>('0' + nanos / 100 % 10), static_cast<char>('0' + nanos / 10 % 10),
+                            static_cast<char>('0' + nanos % 10), '\0'};
+        return to_string(nanos / 1000) + "." + fraction;
+    };
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& buffer : registry.buffers) {
+        uint64_t written = buffer->written.load(memory_order_acquire);
+        uint64_t begin = written > TraceBuffer::capacity ? written - TraceBuffer::capacity : 0;
+        for (uint64_t i = begin; i < written; i++) {
+            const TraceEvent& event = buffer->events[i % TraceBuffer::capacity];
+            file << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << buffer->threadId << ",\"ts\":" << micros(event.startNanos) << ",\"dur\":"
+                 << micros(event.durationNanos) << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    return true;
+}
+
+// Hardware performance counters (cycles, instructions, branch misses, cache misses)
+// read as one perf_event_open group, so all four cover exactly the same interval.
+// Counts user-space work of one thread: the calling thread by default, or the thread
+// with kernel id threadId. If the kernel refuses (e.g. perf_event_paranoid or a
+// container), available stays false and stages are just run.
+struct PerfCounterGroup {
+    static const int counterCount = 4;
+    int fds[counterCount] = {-1, -1, -1, -1};
+    bool available = false;
+
+    explicit PerfCounterGroup(int threadId = 0) {
+#ifdef __linux__
+        const uint64_t configs[counterCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+        for (int i = 0; i < counterCount; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0; // The leader starts the whole group.
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, threadId, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                close();
+                return;
+            }
+        }
+        available = true;
+#else
+        (void)threadId;
+#endif
+    }
+
+    ~PerfCounterGroup() {
+        close();
+    }
+
+    void close() {
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+#endif
+        available = false;
+    }
+
+    void start() {
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Stops counting and stores the four counts in values; returns false on a read error.
+    bool stop(uint64_t values[counterCount]) {
+#ifdef __linux__
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t data[1 + counterCount];
+        if (read(fds[0], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)))
+            return false;
+        for (int i = 0; i < counterCount; i++)
+            values[i] = data[1 + i];
+        return true;
+#else
+        (void)values;
+        return false;
+#endif
+    }
+};
+
+// Counter totals for one measured stage.
+struct StageCounters {
+    string stage;
+    size_t records = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t branchMisses = 0;
+    uint64_t cacheMisses = 0;
+};
+
+// One counter group for the calling thread and one per thread pool worker,
+// so parallel stages are charged for the work their tasks do on the workers.
+struct PerfStages {
+    bool enabled = false;
+    bool opened = false;
+    bool available = false;
+    vector<unique_ptr<PerfCounterGroup>> groups;
+    vector<StageCounters> stages;
+};
+
+PerfStages& perfStages() {
+    static PerfStages stages;
+    return stages;
+}
+
+vector<int> poolWorkerThreadIds();
+
+// Function to run one stage of work, wrapped in hardware counters when --perf is on.
+// Counts are summed over the calling thread and every pool worker.
+// work returns how many records it processed, used to report misses per record.
+void measureStage(const string& stage, const function<size_t()>& work) {
+    PerfStages& perf = perfStages();
+    if (!perf.enabled) {
+        work();
+        return;
+    }
+    if (!perf.opened) {
+        perf.opened = true;
+        perf.available = true;
+        perf.groups.push_back(make_unique<PerfCounterGroup>());
+        for (int threadId : poolWorkerThreadIds())
+            perf.groups.push_back(make_unique<PerfCounterGroup>(threadId));
+        for (const auto& group : perf.groups)
+            perf.available = perf.available && group->available;
+        if (!perf.available)
+            perf.groups.clear();
+    }
+    if (!perf.available) {
+        work();
+        return;
+    }
+    for (const auto& group : perf.groups)
+        group->start();
+    size_t records = work();
+    StageCounters counters{stage, records};
+    for (const auto& group : perf.groups) {
+        uint64_t values[PerfCounterGroup::counterCount];
+        if (!group->stop(values))
+            return;
+        counters.cycles += values[0];
+        counters.instructions += values[1];
+        counters.branchMisses += values[2];
+        counters.cacheMisses += values[3];
+    }
+    perf.stages.push_back(counters);
+}
+
+// Function to print IPC and misses per record for every measured stage.
+void printPerfReport(ostream& out) {
+    PerfStages& perf = perfStages();
+    if (!perf.enabled)
+        return;
+    if (!perf.available) {
+        out << "Hardware counters unavailable (perf_event_open failed)\n";
+        return;
+    }
+    out << "Hardware counters per stage (all threads):\n";
+    for (const auto& stage : perf.stages) {
+        double records = static_cast<double>(max<size_t>(stage.records, 1));
+        out << "  " << stage.stage << ": IPC " << (stage.cycles ? double(stage.instructions) / stage.cycles : 0)
+            << ", " << stage.cycles / records << " cycles, " << stage.branchMisses / records
+            << " branch misses, " << stage.cacheMisses / records << " cache misses per record\n";
+    }
+}
+
+// Parts of the program whose memory use is tracked separately.
+enum MemorySubsystem {
+    NamesMemory,    // The species -> names table
+    IntakeMemory,   // Arriving animal records and intake file buffers
+    OutputMemory,   // Report output buffers
+    ArenaMemory,    // Overflow arena for long InlineString values
+    MemorySubsystemCount
+};
+
+// Byte counters per subsystem, with the highest value each one reached.
+// Counters are atomic so parallel stages can update them.
+struct MemoryCounters {
+    atomic<int64_t> current[MemorySubsystemCount] = {};
+    atomic<int64_t> peak[MemorySubsystemCount] = {};
+};
+
+MemoryCounters& memoryCounters() {
+    static MemoryCounters counters;
+    return counters;
+}
+
+// Function to record that a subsystem allocated (positive) or released (negative) bytes.
+void trackMemory(MemorySubsystem subsystem, int64_t bytes) {
+    MemoryCounters& counters = memoryCounters();
+    int64_t now = counters.current[subsystem] += bytes;
+    int64_t peak = counters.peak[subsystem];
+    while (now > peak && !counters.peak[subsystem].compare_exchange_weak(peak, now)) {
+    }
+}
+
+// Heap bytes owned by a string (zero when it fits in the small-string buffer).
+size_t heapBytes(const string& s) {
+    return s.capacity() > string().capacity() ? s.capacity() + 1 : 0;
+}
+
+// Set when overflow arena blocks should be backed by transparent huge pages (--intake-hugepages).
+atomic<bool> stringArenaHugePages{false};
+
+// Storage for InlineString values too long to keep inline. Strings are carved out of 2 MB
+// blocks and stay where they are until the arena is destroyed, which frees them all at once.
+// Safe to use from several threads. Block memory is counted as ArenaMemory.
+class StringArena {
+    struct Block {
+        char* data;
+        size_t size;
+        bool mapped;
+    };
+    static const size_t blockSize = 2 << 20;
+
+    mutex lock;
+    vector<Block> blocks;
+    char* next = nullptr;
+    size_t left = 0;
+
+    static Block allocateBlock() {
+#ifdef __unix__
+        // Map twice the size so the block can start on a 2 MB boundary, which THP needs.
+        void* mapping = mmap(nullptr, 2 * blockSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED) {
+            uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+            uintptr_t aligned = (start + blockSize - 1) & ~(uintptr_t(blockSize) - 1);
+            if (aligned > start)
+                munmap(mapping, aligned - start);
+            munmap(reinterpret_cast<void*>(aligned + blockSize), start + 2 * blockSize - aligned - blockSize);
+            char* block = reinterpret_cast<char*>(aligned);
+#ifdef MADV_HUGEPAGE
+            if (stringArenaHugePages)
+                madvise(block, blockSize, MADV_HUGEPAGE);
+#endif
+            return {block, blockSize, true};
+        }
+#endif
+        return {new char[blockSize], blockSize, false};
+    }
+
+public:
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    ~StringArena() {
+        for (const Block& block : blocks) {
+            trackMemory(ArenaMemory, -static_cast<int64_t>(block.size));
+#ifdef __unix__
+            if (block.mapped) {
+                munmap(block.data, block.size);
+                continue;
+            }
+#endif
+            delete[] block.data;
+        }
+    }
+
+    const char* store(string_view value) {
+        lock_guard<mutex> guard(lock);
+        if (value.size() > blockSize / 4) {
+            // Rare huge values get their own allocation instead of wasting a block.
+            char* stored = new char[value.size()];
+            memcpy(stored, value.data(), value.size());
+            blocks.push_back({stored, value.size(), false});
+            trackMemory(ArenaMemory, static_cast<int64_t>(value.size()));
+            return stored;
+        }
+        if (value.size() > left) {
+            blocks.push_back(allocateBlock());
+            trackMemory(ArenaMemory, static_cast<int64_t>(blockSize));
+            next = blocks.back().data;
+            left = blockSize;
+        }
+        char* stored = next;
+        memcpy(stored, value.data(), value.size());
+        next += value.size();
+        left -= value.size();
+        return stored;
+    }
+};
+
+// The arena that long InlineString values assigned on this thread go to (set with
+// StringArenaScope). When none is set they go to a process-wide arena that is never freed.
+StringArena*& currentStringArena() {
+    thread_local StringArena* arena = nullptr;
+    return arena;
+}
+
+// Makes an arena current on this thread until the scope ends.
+struct StringArenaScope {
+    StringArena* previous;
+
+    explicit StringArenaScope(StringArena* arena) : previous(currentStringArena()) {
+        currentStringArena() = arena;
+    }
+    ~StringArenaScope() {
+        currentStringArena() = previous;
+    }
+};
+
+const char* storeOverflowString(string_view value) {
+    StringArena* arena = currentStringArena();
+    if (!arena) {
+        static StringArena* processArena = new StringArena(); // Outlives the memory counters.
+        arena = processArena;
+    }
+    return arena->store(value);
+}
+
+// Heap bytes of a vector of animals (long text values are counted under ArenaMemory).
+size_t heapBytes(const vector<Animal>& animals) {
+    return animals.capacity() * sizeof(Animal);
+}
+
+// Returns the peak resident set size of the process in bytes, or 0 if unknown.
+int64_t peakResidentBytes() {
+#ifdef __unix__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return static_cast<int64_t>(usage.ru_maxrss) * 1024; // ru_maxrss is in kilobytes on Linux.
+#endif
+    return 0;
+}
+
+// Returns the current resident set size of the process in bytes, or 0 if unknown.
+int64_t currentResidentBytes() {
+    ifstream statm("/proc/self/statm");
+    int64_t totalPages, residentPages;
+    if (statm >> totalPages >> residentPages)
+        return residentPages * sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+string formatBytes(int64_t bytes) {
+    ostringstream out;
+    out.precision(1);
+    out << fixed;
+    if (bytes >= 1024 * 1024)
+        out << bytes / (1024.0 * 1024.0) << " MB";
+    else
+        out << bytes / 1024.0 << " KB";
+    return out.str();
+}
+
+// Function to print the tracked memory per subsystem and the process RSS.
+void printMemoryReport(ostream& out) {
+    static const char* labels[MemorySubsystemCount] = {"names table", "intake records", "output buffers",
+                                                               "string arena"};
+    MemoryCounters& counters = memoryCounters();
+    out << "Memory usage:\n";
+    for (int i = 0; i < MemorySubsystemCount; i++) {
+        out << "  " << labels[i] << ": " << formatBytes(counters.current[i]) << " (peak "
+            << formatBytes(counters.peak[i]) << ")\n";
+    }
+    // ru_maxrss is only refreshed by the kernel now and then, so it can trail the RSS just
+    // read from /proc; the current value is a lower bound for the peak.
+    int64_t resident = currentResidentBytes();
+    out << "  process RSS: " << formatBytes(resident) << " (peak "
+        << formatBytes(max(resident, peakResidentBytes())) << ")\n";
+}
+
+// ASCII lower-casing, the same as tolower() in the "C" locale but inlined. Unlike ::tolower
+// on a plain char it is defined for bytes above 0x7f, which are left as they are.
+unsigned char asciiLower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + ('a' - 'A')) : static_cast<unsigned char>(c);
+}
+
+// Species -> names table built once from the names file and then only read.
+// Species are found by open addressing (linear probing) in a flat slot array, and every
+// species and name string is stored back to back in one text buffer, so lookups take a
+// string_view without building a temporary string. Slots are hashed on the lower-cased
+// species, so the case-insensitive fallback probes the same chain as the exact lookup.
+//
+// Large pools (frontCodingThreshold names or more) are sorted and front-coded in blocks of
+// 16: the first name of a block is stored whole and each following name as the length of
+// the prefix it shares with the previous name plus the rest. Reading name i decodes at most
+// one block, so access by index stays O(1) while large pools take a fraction of the space.
+class NamesTable {
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+    struct Entry {
+        Span species;
+        uint32_t first;     // First name in nameSpans, or first block in blockOffsets when front-coded
+        uint32_t nameCount;
+        bool frontCoded;
+    };
+
+    static const size_t BlockSize = 16;
+
+    string text;                  // All species characters and plain name characters
+    vector<Span> nameSpans;       // Names of plain pools, grouped by species in file order
+    string coded;                 // Front-coded blocks of the large pools
+    vector<uint32_t> blockOffsets; // Start of each block in coded
+    vector<Entry> entries;        // Sorted by species name
+    vector<uint32_t> slots;       // Entry index + 1, or 0 for an empty slot
+    size_t mask = 0;
+
+    static uint64_t lowerHash(string_view key) {
+        uint64_t h = 1469598103934665603ull;
+        for (char c : key) {
+            h ^= asciiLower(c);
+            h *= 1099511628211ull;
+        }
+        return h ^ (h >> 29);
+    }
+
+    static bool equalsIgnoreCase(string_view a, string_view b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (asciiLower(a[i]) != asciiLower(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Lengths in coded blocks are LEB128 varints; one byte for names under 128 bytes.
+    static void appendVarint(string& out, size_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    static size_t readVarint(const char*& p) {
+        size_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            unsigned char byte = static_cast<unsigned char>(*p++);
+            value |= static_cast<size_t>(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return value;
+        }
+    }
+
+    string_view view(Span span) const {
+        return string_view(text.data() + span.offset, span.length);
+    }
+
+    Span store(string_view value) {
+        Span span{static_cast<uint32_t>(text.size()), static_cast<uint32_t>(value.size())};
+        text.append(value);
+        return span;
+    }
+
+    // Appends sorted names as front-coded blocks; returns the index of the first block.
+    uint32_t encode(const vector<string>& sortedNames) {
+        uint32_t firstBlock = static_cast<uint32_t>(blockOffsets.size());
+        for (size_t i = 0; i < sortedNames.size(); i++) {
+            const string& name = sortedNames[i];
+            if (i % BlockSize == 0) {
+                blockOffsets.push_back(static_cast<uint32_t>(coded.size()));
+                appendVarint(coded, name.size());
+                coded += name;
+                continue;
+            }
+            const string& previous = sortedNames[i - 1];
+            size_t prefix = 0;
+            while (prefix < name.size() && prefix < previous.size() && name[prefix] == previous[prefix])
+                prefix++;
+            appendVarint(coded, prefix);
+            appendVarint(coded, name.size() - prefix);
+            coded.append(name, prefix, string::npos);
+        }
+        return firstBlock;
+    }
+
+    // Decodes name i of the pool whose blocks start at firstBlock.
+    // Only the prefix lengths are needed to skip ahead: the bytes of the wanted name are
+    // gathered once, walking back from the name to the earlier names that supply its prefix.
+    // Decodes name i of the pool starting at firstBlock into name, reusing its capacity.
+    void decode(uint32_t firstBlock, size_t i, string& name) const {
+        const char* p = coded.data() + blockOffsets[firstBlock + i / BlockSize];
+        size_t steps = i % BlockSize;
+        // Start, prefix length and length of each name up to the wanted one.
+        const char* starts[BlockSize];
+        size_t prefixes[BlockSize];
+        size_t lengths[BlockSize];
+        lengths[0] = readVarint(p);
+        prefixes[0] = 0;
+        starts[0] = p;
+        p += lengths[0];
+        for (size_t k = 1; k <= steps; k++) {
+            prefixes[k] = readVarint(p);
+            size_t suffix = readVarint(p);
+            starts[k] = p;
+            lengths[k] = prefixes[k] + suffix;
+            p += suffix;
+        }
+        name.resize(lengths[steps]);
+        size_t end = lengths[steps];
+        for (size_t k = steps + 1; k-- > 0 && end > 0;) {
+            // Name k supplies bytes [prefixes[k], end) of the result.
+            if (prefixes[k] < end) {
+                memcpy(&name[prefixes[k]], starts[k], end - prefixes[k]);
+                end = prefixes[k];
+            }
+        }
+    }
+
+public:
+    // Pools with at least this many names are front-coded unless the constructor says otherwise.
+    static const size_t DefaultFrontCodingThreshold = 256;
+
+    // The names of one species: in names-file order, or sorted for front-coded pools.
+    class Names {
+        const NamesTable* table = nullptr;
+        Entry entry{};
+
+    public:
+        Names() = default;
+        Names(const NamesTable* owner, const Entry& speciesEntry) : table(owner), entry(speciesEntry) {}
+        size_t size() const {
+            return entry.nameCount;
+        }
+        bool empty() const {
+            return entry.nameCount == 0;
+        }
+        bool sorted() const {
+            return entry.frontCoded;
+        }
+        // Returns name i without allocating: a view into the table for plain pools, or into
+        // buffer, which a front-coded name is decoded into (valid until buffer changes).
+        string_view get(size_t i, string& buffer) const {
+            if (!entry.frontCoded)
+                return table->view(table->nameSpans[entry.first + i]);
+            table->decode(entry.first, i, buffer);
+            return buffer;
+        }
+        string operator[](size_t i) const {
+            string buffer;
+            string_view name = get(i, buffer);
+            return entry.frontCoded ? buffer : string(name);
+        }
+    };
+
+    NamesTable() = default;
+
+    // Builds the table from species -> names lists.
+    explicit NamesTable(const map<string, vector<string>>& namesBySpecies,
+                        size_t frontCodingThreshold = DefaultFrontCodingThreshold) {
+        entries.reserve(namesBySpecies.size());
+        for (const auto& pair : namesBySpecies) {
+            Entry entry{store(pair.first), 0, static_cast<uint32_t>(pair.second.size()), false};
+            if (pair.second.size() >= frontCodingThreshold) {
+                vector<string> sortedNames = pair.second;
+                sort(sortedNames.begin(), sortedNames.end());
+                entry.first = encode(sortedNames);
+                entry.frontCoded = true;
+            } else {
+                entry.first = static_cast<uint32_t>(nameSpans.size());
+                for (const auto& name : pair.second)
+                    nameSpans.push_back(store(name));
+            }
+            entries.push_back(entry);
+        }
+        text.shrink_to_fit();
+        nameSpans.shrink_to_fit();
+        coded.shrink_to_fit();
+        blockOffsets.shrink_to_fit();
+        // Keep the load factor at or below one half.
+        size_t capacity = 8;
+        while (capacity < entries.size() * 2)
+            capacity *= 2;
+        slots.assign(capacity, 0);
+        mask = capacity - 1;
+        for (size_t i = 0; i < entries.size(); i++) {
+            size_t slot = lowerHash(view(entries[i].species)) & mask;
+            while (slots[slot] != 0)
+                slot = (slot + 1) & mask;
+            slots[slot] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    // Returns the index of a species (falling back to a case-insensitive match), or -1.
+    long indexOf(string_view species) const {
+        if (slots.empty())
+            return -1;
+        long caseInsensitive = -1;
+        for (size_t slot = lowerHash(species) & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+            uint32_t index = slots[slot] - 1;
+            string_view key = view(entries[index].species);
+            if (key == species)
+                return index;
+            if (caseInsensitive < 0 && equalsIgnoreCase(key, species))
+                caseInsensitive = index;
+        }
+        return caseInsensitive;
+    }
+
+    // Returns the names of a species; empty if the species is unknown.
+    Names find(string_view species) const {
+        long index = indexOf(species);
+        return index < 0 ? Names() : names(index);
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+    string_view species(size_t index) const {
+        return view(entries[index].species);
+    }
+    Names names(size_t index) const {
+        return Names(this, entries[index]);
+    }
+
+    // Heap bytes owned by the table.
+    size_t bytes() const {
+        return text.capacity() + nameSpans.capacity() * sizeof(Span) + coded.capacity() +
+               blockOffsets.capacity() * sizeof(uint32_t) + entries.capacity() * sizeof(Entry) +
+               slots.capacity() * sizeof(uint32_t);
+    }
+};
+
+// Heap bytes of the names table.
+size_t heapBytes(const NamesTable& table) {
+    return table.bytes();
+}
+
 // Function to load animal names from a file.
 // The file should have headers like "Hyena Names:" followed by a line of comma-separated names.
-map<string, vector<string>> loadAnimalNames(const string& filename) {
+NamesTable loadAnimalNames(const string& filename) {
     map<string, vector<string>> namesMap;
     ifstream file(filename);
     if (!file) {
         cerr << "Error opening file: " << filename << endl;
-        return namesMap;
+        return NamesTable();
     }
     string line;
     string currentSpecies;  // Holds the species name from the header line.
@@ -69,136 +1008,3885 @@ map<string, vector<string>> loadAnimalNames(const string& filename) {
         }
     }
     file.close();
-    return namesMap;
+    return NamesTable(namesMap);
 }
 
-// Function to load arriving animal records from a file.
-// Each record should be in one line with exactly six comma-separated fields:
-// Field 0: Age and species (e.g., "4 Hyena")
-// Field 1: Birth season (e.g., "born in spring")
-// Field 2: Color description
-// Field 3: Weight (numeric)
-// Field 4: Origin part 1
-// Field 5: Origin part 2
-vector<Animal> loadArrivingAnimals(const string& filename) {
-    vector<Animal> animals;
-    ifstream file(filename);
-    if (!file) {
-        cerr << "Error opening file: " << filename << endl;
-        return animals;
+// Function to parse a weight such as "70", "270.5" or "81 pounds" into hundredths of a pound.
+// Digits after the second decimal place are rounded half-up; any trailing text is ignored.
+// Parsing is done on integers only, so the value read back from a report is exactly the value written.
+// Returns false if the text does not start with a number or the value does not fit in int64_t.
+bool parseWeight(string_view text, int64_t& hundredths) {
+    size_t i = 0;
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t'))
+        i++;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+'))
+        negative = text[i++] == '-';
+    // Largest whole part whose hundredths (plus a rounded-up fraction) still fit in int64_t.
+    const int64_t maxWhole = (INT64_MAX - 100) / 100;
+    int64_t whole = 0;
+    bool sawDigit = false;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+        int digit = text[i++] - '0';
+        if (whole > (maxWhole - digit) / 10)
+            return false; // Too large to represent.
+        whole = whole * 10 + digit;
+        sawDigit = true;
     }
-    string line;
-    while(getline(file, line)) {
-        line = trim(line);
-        if(line.empty())
-            continue;
-        // Split the line by commas into individual parts.
-        vector<string> parts;
-        stringstream ss(line);
-        string part;
-        while(getline(ss, part, ',')) {
-            parts.push_back(trim(part));
-        }
-        // Check if we have exactly 6 fields; if not, report an invalid record.
-        if (parts.size() < 6) {
-            cerr << "Invalid record: " << line << endl;
-            continue;
+    int64_t fraction = 0;
+    if (i < text.size() && text[i] == '.') {
+        i++;
+        int digits = 0;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+            if (digits < 2)
+                fraction = fraction * 10 + (text[i] - '0');
+            else if (digits == 2 && text[i] >= '5')
+                fraction++; // Round half-up on the third decimal.
+            digits++;
+            sawDigit = true;
+            i++;
         }
-        Animal animal;
-        // Process Field 0: it contains both age and species.
-        {
-            stringstream partStream(parts[0]);
-            string ageStr;
-            partStream >> ageStr; // Extract the age (first word).
-            animal.age = stoi(ageStr); // Convert age string to integer.
-            // The rest of Field 0 is treated as the species.
-            string species;
-            getline(partStream, species);
-            animal.species = trim(species);
-        }
-        // Assign remaining fields from the record.
-        animal.birthSeason = parts[1];
-        animal.color = parts[2];
-        animal.weight = stod(parts[3]); // Convert weight string to double.
-        animal.origin = parts[4] + " " + parts[5]; // Combine the two parts of the origin.
-        // The name will be assigned later based on the species.
-        animals.push_back(animal);
+        if (digits == 1)
+            fraction *= 10;
     }
-    file.close();
-    return animals;
+    if (!sawDigit)
+        return false;
+    hundredths = whole * 100 + fraction;
+    if (negative)
+        hundredths = -hundredths;
+    return true;
 }
 
-// Function to assign a random name to an animal based on its species.
-// Searches the names map for a key matching the species; if not found, attempts a case-insensitive match.
-// Returns "Unnamed" if no matching name is found.
-string assignName(const string& species, map<string, vector<string>>& namesMap) {
-    auto it = namesMap.find(species);
-    if (it == namesMap.end()) {
-        // Perform a case-insensitive search if the direct lookup fails.
-        for (auto& pair : namesMap) {
-            string keyLower = pair.first;
-            string speciesLower = species;
-            transform(keyLower.begin(), keyLower.end(), keyLower.begin(), ::tolower);
-            transform(speciesLower.begin(), speciesLower.end(), speciesLower.begin(), ::tolower);
-            if (keyLower == speciesLower) {
-                it = namesMap.find(pair.first);
-                break;
-            }
-        }
+// Function to append a fixed-point weight in its shortest exact form ("70", "270.5", "12.25").
+void appendWeight(string& out, int64_t hundredths) {
+    // Work on the magnitude as unsigned, since -INT64_MIN does not fit in int64_t.
+    uint64_t magnitude = static_cast<uint64_t>(hundredths);
+    if (hundredths < 0) {
+        out.push_back('-');
+        magnitude = 0 - magnitude;
     }
-    if (it != namesMap.end() && !it->second.empty()) {
-        int index = rand() % it->second.size(); // Randomly choose one of the available names.
-        return it->second[index];
+    char digits[24];
+    int length = 0;
+    uint64_t whole = magnitude / 100;
+    do {
+        digits[length++] = static_cast<char>('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (length > 0)
+        out.push_back(digits[--length]);
+    int fraction = static_cast<int>(magnitude % 100);
+    if (fraction != 0) {
+        out.push_back('.');
+        out.push_back(static_cast<char>('0' + fraction / 10));
+        if (fraction % 10 != 0)
+            out.push_back(static_cast<char>('0' + fraction % 10));
     }
-    return "Unnamed"; // Return a default name if no match is found.
 }
 
-// Function to update the animal report file by appending new animal records.
-// The file is written in CSV format with the following fields:
-// name, species, age, birth season, color, weight, origin.
-// Note: The output report file is now "newAnimals.txt" instead of "zooPopulation.txt".
-void updateZooPopulation(const string& filename, const vector<Animal>& animals) {
-    // Open the file in append mode.
-    ofstream file(filename, ios::app);
-    if (!file) {
-        cerr << "Error opening file for writing: " << filename << endl;
-        return;
-    }
-    // Write each animal's data in CSV format.
-    for (const auto& animal : animals) {
-        file << animal.name << ", "
-             << animal.species << ", "
-             << animal.age << ", "
-             << animal.birthSeason << ", "
-             << animal.color << ", "
-             << animal.weight << ", "
-             << animal.origin << "\n";
-    }
-    file.close();
+string formatWeight(int64_t hundredths) {
+    string text;
+    appendWeight(text, hundredths);
+    return text;
 }
 
-int main() {
-    // Seed the random number generator with the current time.
-    srand(static_cast<unsigned int>(time(NULL)));
-    
-    // Load animal names from the file "animalNames.txt".
-    map<string, vector<string>> animalNamesMap = loadAnimalNames("animalNames.txt");
-    
-    // Load arriving animal records from the file "arrivingAnimals.txt".
-    vector<Animal> arrivingAnimals = loadArrivingAnimals("arrivingAnimals.txt");
+// Converts a fixed-point weight to pounds for statistics that need real numbers.
+double weightInPounds(int64_t hundredths) {
+    return hundredths / 100.0;
+}
+
+// One-pass detector for implausible weights (e.g. bad scale readings).
+// Keeps a running mean and variance per species (Welford's algorithm) and flags an animal
+// whose weight lies more than zThreshold standard deviations from its species mean.
+// To stay robust, flagged weights are not folded into the statistics, nothing is flagged
+// until a species has warmupCount readings, and the deviation is never taken smaller than
+// minRelativeSpread of the mean so a run of identical weights cannot flag a tiny change.
+struct WeightAnomalyDetector {
+    struct RunningStats {
+        uint64_t count = 0;
+        double mean = 0;
+        double m2 = 0; // Sum of squared differences from the mean.
+    };
+
+    double zThreshold = 4.0;
+    uint64_t warmupCount = 10;
+    double minRelativeSpread = 0.05;
+    map<string, RunningStats, less<>> stats;
+
+    // Returns a reason if the animal's weight looks wrong, or an empty string otherwise.
+    string check(const Animal& animal) {
+        if (animal.weight <= 0)
+            return "non-positive weight";
+        double weight = weightInPounds(animal.weight);
+        auto it = stats.find(animal.species.view());
+        if (it == stats.end())
+            it = stats.emplace(animal.species.str(), RunningStats()).first;
+        RunningStats& s = it->second;
+        if (s.count >= warmupCount) {
+            double stddev = sqrt(s.m2 / (s.count - 1));
+            double spread = max(stddev, minRelativeSpread * fabs(s.mean));
+            double z = (weight - s.mean) / spread;
+            if (fabs(z) > zThreshold) {
+                ostringstream reason;
+                reason << "weight " << formatWeight(animal.weight) << " is " << z << " deviations from species mean " << s.mean;
+                return reason.str();
+            }
+        }
+        s.count++;
+        double delta = weight - s.mean;
+        s.mean += delta / s.count;
+        s.m2 += delta * (weight - s.mean);
+        return "";
+    }
+};
+
+// Function to find the next '"' or '\\' at or after p, the only characters that end or
+// interrupt a JSON string. With SSE2 it tests 16 bytes per step; returns end if none is found.
+const char* findQuoteOrBackslash(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\')
+        p++;
+    return p;
+}
+
+// Cursor over one JSON Lines record for the flat Animal schema.
+// Only objects whose values are strings or numbers are supported (no nesting).
+struct JsonRecordParser {
+    const char* p;
+    const char* end;
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    // Appends a UTF-8 encoded code point.
+    static void appendUtf8(string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool parseHex4(uint32_t& value) {
+        if (end - p < 4)
+            return false;
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    // Parses a quoted string into out. Unescaped runs are found with findQuoteOrBackslash()
+    // and copied in one append.
+    bool parseString(string& out) {
+        out.clear();
+        if (!consume('"'))
+            return false;
+        while (true) {
+            const char* stop = findQuoteOrBackslash(p, end);
+            out.append(p, stop);
+            p = stop;
+            if (p >= end)
+                return false;
+            if (*p++ == '"')
+                return true;
+            if (p >= end)
+                return false;
+            char escaped = *p++;
+            switch (escaped) {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!parseHex4(cp))
+                        return false;
+                    // Combine a UTF-16 surrogate pair into one code point. An unpaired
+                    // surrogate has no UTF-8 encoding, so it is rejected.
+                    if (cp >= 0xDC00 && cp < 0xE000)
+                        return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+                            return false;
+                        p += 2;
+                        uint32_t low;
+                        if (!parseHex4(low) || low < 0xDC00 || low >= 0xE000)
+                            return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    // Parses a quoted string. A string without escapes is returned as a view of the input;
+    // otherwise it is decoded into scratch and out views scratch.
+    bool parseStringView(string_view& out, string& scratch) {
+        skipSpace();
+        if (p >= end || *p != '"')
+            return false;
+        const char* start = p + 1;
+        const char* stop = findQuoteOrBackslash(start, end);
+        if (stop < end && *stop == '"') {
+            out = string_view(start, stop - start);
+            p = stop + 1;
+            return true;
+        }
+        if (!parseString(scratch))
+            return false;
+        out = scratch;
+        return true;
+    }
+
+    // Returns the raw text of a number value (up to the next ',' or '}').
+    bool parseNumberText(string_view& text) {
+        skipSpace();
+        const char* start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t')
+            p++;
+        text = string_view(start, p - start);
+        return !text.empty();
+    }
+};
+
+// Returns true if text is a JSON number without an exponent: -?digits(.digits)?
+bool isPlainDecimal(string_view text) {
+    size_t i = !text.empty() && text[0] == '-' ? 1 : 0;
+    size_t digits = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+        i++;
+        digits++;
+    }
+    if (digits == 0)
+        return false;
+    if (i < text.size() && text[i] == '.') {
+        size_t fractionStart = ++i;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+            i++;
+        if (i == fractionStart)
+            return false;
+    }
+    return i == text.size();
+}
+
+// Function to parse one JSON object of the flat Animal schema, as written by appendJsonRecord():
+// {"id":..,"name":..,"species":..,"age":..,"birthSeason":..,"color":..,"weight":..,"origin":..}
+// age, species and weight are required. weight may be a number or a string such as "70 pounds".
+// Unknown keys are skipped if their values are strings or numbers.
+// Text fields may not contain commas or control characters (such as an escaped newline),
+// since the CSV report and the diff/join spill files could not represent them.
+// age and id must be whole numbers. A numeric weight must be a plain decimal ("81.5");
+// exponent forms such as 1.5e2 are rejected rather than misread.
+// Returns false if the record is malformed, a text field is not allowed, or a required
+// field is missing.
+bool parseJsonAnimal(string_view line, Animal& animal) {
+    JsonRecordParser parser{line.data(), line.data() + line.size()};
+    if (!parser.consume('{'))
+        return false;
+    animal = Animal();
+    bool hasAge = false, hasSpecies = false, hasWeight = false;
+    thread_local string keyScratch, valueScratch;
+    string_view key, value;
+    if (!parser.consume('}')) {
+        do {
+            if (!parser.parseStringView(key, keyScratch) || !parser.consume(':'))
+                return false;
+            parser.skipSpace();
+            if (parser.p < parser.end && *parser.p == '"') {
+                if (!parser.parseStringView(value, valueScratch))
+                    return false;
+                bool allowed = true;
+                auto setText = [&value, &allowed](auto& field) {
+                    for (char c : value)
+                        allowed = allowed && c != ',' && static_cast<unsigned char>(c) >= 0x20;
+                    field = value;
+                };
+                if (key == "species") {
+                    setText(animal.species);
+                    hasSpecies = true;
+                } else if (key == "name") {
+                    setText(animal.name);
+                } else if (key == "birthSeason") {
+                    setText(animal.birthSeason);
+                } else if (key == "color") {
+                    setText(animal.color);
+                } else if (key == "origin") {
+                    setText(animal.origin);
+                } else if (key == "weight") {
+                    hasWeight = parseWeight(value, animal.weight);
+                }
+                if (!allowed)
+                    return false;
+            } else {
+                string_view number;
+                if (!parser.parseNumberText(number))
+                    return false;
+                const char* numberEnd = number.data() + number.size();
+                if (key == "age") {
+                    auto result = from_chars(number.data(), numberEnd, animal.age);
+                    hasAge = result.ec == errc() && result.ptr == numberEnd;
+                } else if (key == "id") {
+                    auto result = from_chars(number.data(), numberEnd, animal.id);
+                    if (result.ec != errc() || result.ptr != numberEnd)
+                        return false;
+                } else if (key == "weight") {
+                    hasWeight = isPlainDecimal(number) && parseWeight(number, animal.weight);
+                }
+            }
+        } while (parser.consume(','));
+        if (!parser.consume('}'))
+            return false;
+    }
+    parser.skipSpace();
+    if (parser.p != parser.end)
+        return false; // Text after the closing brace.
+    return hasAge && hasSpecies && hasWeight;
+}
+
+// A unit of work for the thread pool.
+typedef function<void()> Task;
+
+// Chase-Lev work-stealing deque of tasks.
+// The owning worker pushes and takes at the bottom without locks; other threads steal
+// from the top with a single compare-and-swap. The ring grows when full; old rings are
+// kept until the deque is destroyed, since a thief may still be reading from one.
+class ChaseLevDeque {
+    struct Ring {
+        int64_t capacity;
+        unique_ptr<atomic<Task*>[]> slots;
+
+        explicit Ring(int64_t capacity) : capacity(capacity), slots(new atomic<Task*>[capacity]) {}
+        Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(memory_order_relaxed); }
+        void put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, memory_order_relaxed); }
+    };
+
+    atomic<int64_t> top{0};
+    atomic<int64_t> bottom{0};
+    atomic<Ring*> ring;
+    vector<unique_ptr<Ring>> rings; // Owns every ring ever used (only touched by the owner).
+
+public:
+    ChaseLevDeque() {
+        rings.push_back(make_unique<Ring>(1024));
+        ring.store(rings.back().get(), memory_order_relaxed);
+    }
+
+    // Owner only.
+    void push(Task* task) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        Ring* r = ring.load(memory_order_relaxed);
+        if (b - t > r->capacity - 1) {
+            rings.push_back(make_unique<Ring>(r->capacity * 2));
+            Ring* bigger = rings.back().get();
+            for (int64_t i = t; i < b; i++)
+                bigger->put(i, r->get(i));
+            ring.store(bigger, memory_order_release);
+            r = bigger;
+        }
+        r->put(b, task);
+        // Release publishes the task to thieves that acquire bottom.
+        bottom.store(b + 1, memory_order_release);
+    }
+
+    // Owner only. Returns nullptr when empty.
+    Task* take() {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        Ring* r = ring.load(memory_order_relaxed);
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+        Task* task = nullptr;
+        if (t <= b) {
+            task = r->get(b);
+            if (t == b) {
+                // Last task: race against thieves for it.
+                if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                    task = nullptr;
+                bottom.store(b + 1, memory_order_relaxed);
+            }
+        } else {
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Any thread. Returns nullptr when empty or when another thread won the race.
+    Task* steal() {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Ring* r = ring.load(memory_order_acquire);
+        Task* task = r->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return nullptr;
+        return task;
+    }
+};
+
+// NUMA layout of the machine: the CPUs that belong to each memory node.
+// An empty list means NUMA placement is off.
+struct NumaTopology {
+    vector<vector<int>> nodeCpus;
+    bool simulated = false;
+};
+
+// Function to parse a sysfs CPU list such as "0-3,8-11".
+vector<int> parseCpuList(const string& text) {
+    vector<int> cpus;
+    stringstream ss(text);
+    string range;
+    while (getline(ss, range, ',')) {
+        range = trim(range);
+        if (range.empty())
+            continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Function to read the NUMA nodes of this machine from /sys/devices/system/node.
+// Returns an empty topology on single-node machines or when sysfs is not available.
+NumaTopology detectNumaTopology() {
+    NumaTopology topology;
+    for (int node = 0;; node++) {
+        ifstream cpuList("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        string text;
+        if (!cpuList || !getline(cpuList, text))
+            break;
+        vector<int> cpus = parseCpuList(text);
+        if (!cpus.empty())
+            topology.nodeCpus.push_back(cpus);
+    }
+    if (topology.nodeCpus.size() < 2)
+        topology.nodeCpus.clear();
+    return topology;
+}
+
+// Function to pretend the machine has nodeCount NUMA nodes by splitting its CPUs evenly,
+// so NUMA placement can be exercised and benchmarked on a single-node machine.
+NumaTopology simulatedNumaTopology(size_t nodeCount) {
+    NumaTopology topology;
+    topology.simulated = true;
+    size_t cpus = max(1u, thread::hardware_concurrency());
+    topology.nodeCpus.resize(max<size_t>(nodeCount, 1));
+    for (size_t node = 0; node < topology.nodeCpus.size(); node++) {
+        // With fewer CPUs than nodes, nodes share CPUs.
+        size_t first = node * cpus / topology.nodeCpus.size();
+        size_t last = max(first + 1, (node + 1) * cpus / topology.nodeCpus.size());
+        for (size_t cpu = first; cpu < last; cpu++)
+            topology.nodeCpus[node].push_back(static_cast<int>(cpu % cpus));
+    }
+    return topology;
+}
+
+// Settings for the shared thread pool; must be set before the first parallel stage runs.
+struct ThreadPoolConfig {
+    size_t threads = max(1u, thread::hardware_concurrency()); // Total threads, including the caller.
+    bool pinThreads = false;                                   // Pin worker i to core i.
+    NumaTopology numa;                                         // Bind workers to nodes when not empty.
+};
+
+ThreadPoolConfig& threadPoolConfig() {
+    static ThreadPoolConfig config;
+    return config;
+}
+
+// Work-stealing thread pool shared by every parallel stage of the program.
+// Each worker owns a Chase-Lev deque. Tasks submitted from a worker go to its own deque;
+// tasks from other threads go to a shared injection queue. Idle workers steal from the
+// injection queue and from random other workers, and sleep when there is no work anywhere.
+// The pool has threads - 1 workers because the submitting thread helps while it waits.
+// With a NUMA topology, workers are spread over the nodes and bound to their node's CPUs,
+// and tasks can be queued for a node: that node's workers run them first, other workers
+// only take them once they have nothing else to do, and threads outside the pool never do.
+class WorkStealingPool {
+    struct Worker {
+        ChaseLevDeque deque;
+        thread handle;
+        size_t node = 0;
+        atomic<int> threadId{0}; // Kernel thread id, set once the worker has started.
+    };
+
+    struct NodeQueue {
+        mutex lock;
+        deque<Task*> tasks;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<unique_ptr<NodeQueue>> nodeQueues; // One per NUMA node (a single one without NUMA).
+    mutex injectLock;
+    deque<Task*> injected;
+    atomic<int64_t> queued{0}; // Tasks submitted but not yet started.
+    atomic<bool> stopping{false};
+    mutex sleepLock;
+    condition_variable wake;
+
+    static int& currentWorker() {
+        thread_local int index = -1;
+        return index;
+    }
+
+    static Task* popFront(mutex& lock, deque<Task*>& tasks) {
+        lock_guard<mutex> guard(lock);
+        if (tasks.empty())
+            return nullptr;
+        Task* task = tasks.front();
+        tasks.pop_front();
+        return task;
+    }
+
+    Task* findTask(int self, uint64_t& seed) {
+        if (self >= 0) {
+            if (Task* task = workers[self]->deque.take())
+                return task;
+            NodeQueue& local = *nodeQueues[workers[self]->node];
+            if (Task* task = popFront(local.lock, local.tasks))
+                return task;
+        }
+        if (Task* task = popFront(injectLock, injected))
+            return task;
+        size_t count = workers.size();
+        for (size_t attempt = 0; attempt < count; attempt++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t victim = (seed >> 33) % count;
+            if (static_cast<int>(victim) == self)
+                continue;
+            if (Task* task = workers[victim]->deque.steal())
+                return task;
+        }
+        // Last resort: run work queued for another node. Threads outside the pool never do,
+        // since they belong to no node and would pull node work away from its workers.
+        if (self < 0)
+            return nullptr;
+        for (auto& queue : nodeQueues) {
+            if (Task* task = popFront(queue->lock, queue->tasks))
+                return task;
+        }
+        return nullptr;
+    }
+
+    void workerLoop(int self) {
+        currentWorker() = self;
+#ifdef __linux__
+        workers[self]->threadId.store(static_cast<int>(syscall(SYS_gettid)), memory_order_release);
+#endif
+        uint64_t seed = static_cast<uint64_t>(self) * 0x9e3779b97f4a7c15ULL + 1;
+        while (!stopping.load(memory_order_acquire)) {
+            if (runOne(seed))
+                continue;
+            unique_lock<mutex> guard(sleepLock);
+            wake.wait(guard, [this]() { return stopping.load() || queued.load() > 0; });
+        }
+    }
+
+    static void pinToCpus(thread& handle, const vector<int>& cpuList) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : cpuList)
+            CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(handle.native_handle(), sizeof(cpus), &cpus);
+#else
+        (void)handle;
+        (void)cpuList;
+#endif
+    }
+
+public:
+    WorkStealingPool(const ThreadPoolConfig& config) {
+        const vector<vector<int>>& nodeCpus = config.numa.nodeCpus;
+        size_t nodes = max<size_t>(1, nodeCpus.size());
+        for (size_t node = 0; node < nodes; node++)
+            nodeQueues.push_back(make_unique<NodeQueue>());
+        for (size_t i = 0; i + 1 < config.threads; i++) {
+            workers.push_back(make_unique<Worker>());
+            workers.back()->node = i % nodes;
+        }
+        // Start threads only after every deque exists, since workers steal from each other.
+        size_t cores = max(1u, thread::hardware_concurrency());
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->handle = thread(&WorkStealingPool::workerLoop, this, static_cast<int>(i));
+            if (!nodeCpus.empty())
+                pinToCpus(workers[i]->handle, nodeCpus[workers[i]->node]);
+            else if (config.pinThreads)
+                pinToCpus(workers[i]->handle, {static_cast<int>((i + 1) % cores)}); // Core 0 is left for the main thread.
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker->handle.join();
+    }
+
+    size_t workerCount() const {
+        return workers.size();
+    }
+
+    size_t nodeCount() const {
+        return nodeQueues.size();
+    }
+
+    // Kernel thread ids of the workers (empty off Linux); waits for workers still starting.
+    vector<int> workerThreadIds() const {
+        vector<int> ids;
+#ifdef __linux__
+        for (const auto& worker : workers) {
+            int id;
+            while ((id = worker->threadId.load(memory_order_acquire)) == 0)
+                this_thread::yield();
+            ids.push_back(id);
+        }
+#endif
+        return ids;
+    }
+
+    // Submits a task; pass a node to prefer that NUMA node's workers.
+    void submit(Task task, int node = -1) {
+        Task* heapTask = new Task(move(task));
+        queued.fetch_add(1, memory_order_release);
+        int self = currentWorker();
+        if (node >= 0 && nodeQueues.size() > 1) {
+            NodeQueue& queue = *nodeQueues[node % nodeQueues.size()];
+            lock_guard<mutex> guard(queue.lock);
+            queue.tasks.push_back(heapTask);
+        } else if (self >= 0) {
+            workers[self]->deque.push(heapTask);
+        } else {
+            lock_guard<mutex> guard(injectLock);
+            injected.push_back(heapTask);
+        }
+        if (!workers.empty()) {
+            lock_guard<mutex> guard(sleepLock);
+            // Node tasks may only suit some workers, so wake everyone for them.
+            if (node >= 0)
+                wake.notify_all();
+            else
+                wake.notify_one();
+        }
+    }
+
+    // Runs one pending task on the calling thread, if any can be found.
+    bool runOne(uint64_t& seed) {
+        Task* task = findTask(currentWorker(), seed);
+        if (!task)
+            return false;
+        queued.fetch_sub(1, memory_order_relaxed);
+        (*task)();
+        delete task;
+        return true;
+    }
+};
+
+WorkStealingPool& threadPool() {
+    static WorkStealingPool pool(threadPoolConfig());
+    return pool;
+}
+
+vector<int> poolWorkerThreadIds() {
+    return threadPool().workerThreadIds();
+}
+
+// Returns how many threads parallel stages use, including the calling thread.
+size_t parallelism() {
+    return threadPool().workerCount() + 1;
+}
+
+// Function to run tasks 0..taskCount-1 on the shared thread pool and wait for all of them.
+// The calling thread runs pool tasks while it waits, so nested calls cannot deadlock.
+// If nodeOfTask is given, task i is queued for NUMA node nodeOfTask(i).
+void runParallel(size_t taskCount, const function<void(size_t)>& task,
+                 const function<size_t(size_t)>& nodeOfTask = nullptr) {
+    WorkStealingPool& pool = threadPool();
+    if (pool.workerCount() == 0 || taskCount <= 1) {
+        for (size_t i = 0; i < taskCount; i++)
+            task(i);
+        return;
+    }
+    atomic<size_t> remaining(taskCount);
+    for (size_t i = 0; i < taskCount; i++) {
+        pool.submit([&task, &remaining, i]() {
+            task(i);
+            remaining.fetch_sub(1, memory_order_release);
+        }, nodeOfTask ? static_cast<int>(nodeOfTask(i)) : -1);
+    }
+    uint64_t seed = reinterpret_cast<uintptr_t>(&remaining);
+    while (remaining.load(memory_order_acquire) > 0) {
+        if (!pool.runOne(seed))
+            this_thread::yield();
+    }
+}
+
+// Tuning knobs for reading intake files through a memory mapping.
+struct IntakeOptions {
+    bool populate = false;   // MAP_POPULATE: fault in the whole file when it is mapped
+    bool sequential = true;  // MADV_SEQUENTIAL and POSIX_FADV_SEQUENTIAL: larger readahead, early page reuse
+    bool willNeed = false;   // POSIX_FADV_WILLNEED: start reading the whole file in the background
+    bool hugePages = false;  // MADV_HUGEPAGE on the mapping and on intake arenas
+    bool parallel = true;    // Parse large files in chunks on the thread pool
+};
+
+// Read-only view of a whole file. On POSIX systems the file is memory-mapped and the
+// options are applied as kernel hints; elsewhere (or if mapping fails) it is read into memory.
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    string contents; // Used when the file could not be mapped.
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef __unix__
+        if (mapped)
+            munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    bool open(const string& filename, const IntakeOptions& options) {
+#ifdef __unix__
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size == 0) {
+            ::close(fd);
+            return true; // Nothing to map.
+        }
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+#ifdef POSIX_FADV_SEQUENTIAL
+            if (options.sequential)
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            if (options.willNeed)
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            if (options.populate)
+                flags |= MAP_POPULATE;
+#endif
+            void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, flags, fd, 0);
+            if (address != MAP_FAILED) {
+                data = static_cast<const char*>(address);
+                size = static_cast<size_t>(info.st_size);
+                mapped = true;
+                if (options.sequential)
+                    madvise(address, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+                if (options.hugePages)
+                    madvise(address, size, MADV_HUGEPAGE);
+#endif
+                ::close(fd);
+                return true;
+            }
+        }
+        ::close(fd);
+#else
+        (void)options;
+#endif
+        // Fall back to reading the file into memory.
+        ifstream file(filename, ios::binary);
+        if (!file)
+            return false;
+        contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+        trackMemory(IntakeMemory, static_cast<int64_t>(contents.capacity()));
+        return true;
+    }
+};
+
+// Function to parse one CSV arrival record (see loadArrivingAnimals() for the layout).
+// Returns false if the record does not have six fields or its age or weight is not a number.
+bool parseArrivingRecord(string_view line, Animal& animal) {
+    // Split the line by commas into individual (trimmed) parts.
+    string_view parts[6];
+    size_t count = 0;
+    size_t start = 0;
+    auto trimView = [](string_view v) {
+        size_t first = v.find_first_not_of(" \t\r");
+        if (first == string_view::npos)
+            return string_view();
+        return v.substr(first, v.find_last_not_of(" \t\r") - first + 1);
+    };
+    while (count < 6) {
+        size_t comma = line.find(',', start);
+        // The sixth field keeps everything up to the next comma, as before.
+        parts[count++] = trimView(line.substr(start, comma == string_view::npos ? string_view::npos : comma - start));
+        if (comma == string_view::npos)
+            break;
+        start = comma + 1;
+    }
+    // Check if we have 6 fields; if not, the record is invalid.
+    if (count < 6)
+        return false;
+    // Process Field 0: it contains both age and species.
+    string_view field0 = parts[0];
+    size_t ageEnd = field0.find_first_of(" \t");
+    string_view ageText = field0.substr(0, ageEnd); // Extract the age (first word).
+    if (from_chars(ageText.data(), ageText.data() + ageText.size(), animal.age).ec != errc())
+        return false;
+    // The rest of Field 0 is treated as the species.
+    animal.species.assign(ageEnd == string_view::npos ? string_view() : trimView(field0.substr(ageEnd)));
+    // Assign remaining fields from the record.
+    animal.birthSeason.assign(parts[1]);
+    animal.color.assign(parts[2]);
+    // Convert the weight string to fixed-point hundredths of a pound.
+    if (!parseWeight(parts[3], animal.weight))
+        return false;
+    // Combine the two parts of the origin on the stack, so a long origin is stored once.
+    char origin[256];
+    size_t originSize = parts[4].size() + 1 + parts[5].size();
+    if (originSize <= sizeof(origin)) {
+        memcpy(origin, parts[4].data(), parts[4].size());
+        origin[parts[4].size()] = ' ';
+        memcpy(origin + parts[4].size() + 1, parts[5].data(), parts[5].size());
+        animal.origin.assign(string_view(origin, originSize));
+    } else {
+        animal.origin.assign(string(parts[4]) + ' ' + string(parts[5]));
+    }
+    return true;
+}
+
+// Arriving animals, kept in the chunks they were parsed in. Each chunk was allocated by the
+// workers of one NUMA node; copying the chunks into one vector would move every record to
+// the caller's node. Iteration and parallelBatches() visit the records in file order.
+// The chunks' long text values live in arenas owned here, so they are freed with the
+// animals (copies of the records must not outlive this object).
+struct ArrivingAnimals {
+    vector<unique_ptr<StringArena>> arenas; // Long text values of each chunk; may be empty.
+    vector<vector<Animal>> chunks;
+    vector<size_t> chunkNodes; // NUMA node of each chunk; empty on single-node machines.
+
+    template <class Chunks, class Value>
+    class Iterator {
+        Chunks* chunks = nullptr;
+        size_t chunk = 0;
+        size_t index = 0;
+
+        void skipEmpty() {
+            while (chunk < chunks->size() && index == (*chunks)[chunk].size()) {
+                chunk++;
+                index = 0;
+            }
+        }
+
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef Animal value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        Iterator(Chunks* owner, size_t first) : chunks(owner), chunk(first) {
+            skipEmpty();
+        }
+        Value& operator*() const {
+            return (*chunks)[chunk][index];
+        }
+        Value* operator->() const {
+            return &(*chunks)[chunk][index];
+        }
+        Iterator& operator++() {
+            index++;
+            skipEmpty();
+            return *this;
+        }
+        bool operator==(const Iterator& other) const {
+            return chunk == other.chunk && index == other.index;
+        }
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+    };
+    typedef Iterator<vector<vector<Animal>>, Animal> iterator;
+    typedef Iterator<const vector<vector<Animal>>, const Animal> const_iterator;
+
+    ArrivingAnimals() = default;
+    // Wraps animals that were not parsed per node (one chunk, no node preference).
+    explicit ArrivingAnimals(vector<Animal> animals) {
+        chunks.push_back(move(animals));
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& chunk : chunks)
+            total += chunk.size();
+        return total;
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    iterator begin() {
+        return iterator(&chunks, 0);
+    }
+    iterator end() {
+        return iterator(&chunks, chunks.size());
+    }
+    const_iterator begin() const {
+        return const_iterator(&chunks, 0);
+    }
+    const_iterator end() const {
+        return const_iterator(&chunks, chunks.size());
+    }
+
+    // Function to run work on every batch of up to batchSize consecutive animals on the
+    // thread pool. A batch is queued for the node of its chunk, so it is processed where
+    // its records live, and long values it assigns go to the chunk's arena.
+    void parallelBatches(size_t batchSize, const function<void(Animal* first, Animal* last)>& work) {
+        vector<pair<size_t, size_t>> batches; // (chunk, first index)
+        for (size_t c = 0; c < chunks.size(); c++) {
+            for (size_t i = 0; i < chunks[c].size(); i += batchSize)
+                batches.push_back({c, i});
+        }
+        function<size_t(size_t)> nodeOfBatch;
+        if (!chunkNodes.empty())
+            nodeOfBatch = [&](size_t b) { return chunkNodes[batches[b].first]; };
+        runParallel(
+            batches.size(),
+            [&](size_t b) {
+                StringArenaScope arenaScope(batches[b].first < arenas.size() ? arenas[batches[b].first].get() : nullptr);
+                vector<Animal>& chunk = chunks[batches[b].first];
+                size_t first = batches[b].second;
+                work(chunk.data() + first, chunk.data() + min(chunk.size(), first + batchSize));
+            },
+            nodeOfBatch);
+    }
+};
+
+// Heap bytes of all chunks of arriving animals.
+size_t heapBytes(const ArrivingAnimals& animals) {
+    size_t bytes = 0;
+    for (const auto& chunk : animals.chunks)
+        bytes += heapBytes(chunk);
+    return bytes;
+}
+
+// Result of parsing one chunk of an intake file.
+struct ArrivalsChunk {
+    unique_ptr<StringArena> arena = make_unique<StringArena>(); // Long text values of animals
+    vector<Animal> animals;
+    vector<string_view> lines; // Source line of each animal, valid while the parsed text is.
+    vector<string> flagged;    // Review file lines for suspicious weights.
+    vector<string> invalid;    // Lines that could not be parsed.
+};
+
+// Function to parse the arrival records in a block of whole lines.
+// Chunks are independent, so they can be parsed in parallel; weights are checked afterwards
+// (see flagWeightAnomalies()).
+void parseArrivalsChunk(string_view text, bool json, ArrivalsChunk& chunk) {
+    TraceScope trace("parse chunk");
+    StringArenaScope arenaScope(chunk.arena.get());
+    const char* p = text.data();
+    const char* end = p + text.size();
+    chunk.animals.reserve(text.size() / 128);
+    while (p < end) {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* lineEnd = newline ? newline : end;
+        string_view line(p, lineEnd - p);
+        p = lineEnd + 1;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string_view::npos)
+            continue;
+        line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+        // Parse straight into the result vector to avoid copying the strings again.
+        chunk.animals.emplace_back();
+        Animal& animal = chunk.animals.back();
+        bool valid = json ? parseJsonAnimal(line, animal) : parseArrivingRecord(line, animal);
+        if (!valid) {
+            chunk.animals.pop_back();
+            chunk.invalid.emplace_back(line);
+            continue;
+        }
+        // IDs are assigned at intake and names later based on the species, never taken from the supplier.
+        animal.id = 0;
+        animal.name.clear();
+        chunk.lines.push_back(line);
+    }
+}
+
+// Function to flag implausible weights of a parsed chunk for review.
+// The detector carries its running statistics from chunk to chunk, so calling this on the
+// chunks of a file in file order flags exactly what one pass over the file would, however
+// the file was split.
+void flagWeightAnomalies(WeightAnomalyDetector& detector, ArrivalsChunk& chunk) {
+    for (size_t i = 0; i < chunk.animals.size(); i++) {
+        string reason = detector.check(chunk.animals[i]);
+        if (!reason.empty())
+            chunk.flagged.push_back(string(chunk.lines[i]) + " # " + reason);
+    }
+    chunk.lines = vector<string_view>();
+}
+
+// Function to load arriving animal records from a file.
+// Each record should be in one line with exactly six comma-separated fields:
+// Field 0: Age and species (e.g., "4 Hyena")
+// Field 1: Birth season (e.g., "born in spring")
+// Field 2: Color description
+// Field 3: Weight (numeric)
+// Field 4: Origin part 1
+// Field 5: Origin part 2
+// Files ending in ".jsonl" are read as JSON Lines instead, one flat object per line
+// (see parseJsonAnimal()).
+// The file is memory-mapped (see IntakeOptions) and split into lines with memchr, so records
+// are parsed straight out of the file without copying lines. Large files are parsed in
+// chunks on the thread pool. The chunks are returned as they are (see ArrivingAnimals),
+// so records stay on the NUMA node that parsed them; iteration keeps their file order.
+// Animals with suspicious weights are still loaded, but their records are also
+// appended to reviewFilename together with the reason they were flagged.
+ArrivingAnimals loadArrivingAnimals(const string& filename, const string& reviewFilename = "weightReview.txt",
+                                   const IntakeOptions& options = IntakeOptions()) {
+    bool json = filename.size() >= 6 && filename.compare(filename.size() - 6, 6, ".jsonl") == 0;
+    TraceScope trace(json ? "parse JSON arrivals" : "parse arrivals");
+    if (options.hugePages)
+        stringArenaHugePages = true;
+    ArrivingAnimals animals;
+    MappedFile file;
+    if (!file.open(filename, options)) {
+        cerr << "Error opening file: " << filename << endl;
+        return animals;
+    }
+    // Split the file into chunks that end on line boundaries. With several NUMA nodes, chunk i
+    // is queued for node i * nodes / chunks, so each node parses a contiguous part of the file
+    // and its records are allocated (first touched) by that node's workers.
+    const size_t minChunkBytes = 1 << 20;
+    size_t chunkCount = 1;
+    if (options.parallel && parallelism() > 1)
+        chunkCount = max<size_t>(1, min(file.size / minChunkBytes, parallelism() * 4));
+    vector<string_view> pieces;
+    size_t start = 0;
+    for (size_t i = 1; i <= chunkCount && start < file.size; i++) {
+        size_t cut = i == chunkCount ? file.size : max(start, file.size * i / chunkCount);
+        const char* newline = cut < file.size ? static_cast<const char*>(memchr(file.data + cut, '\n', file.size - cut))
+                                              : nullptr;
+        size_t stop = newline ? newline - file.data + 1 : file.size;
+        pieces.emplace_back(file.data + start, stop - start);
+        start = stop;
+    }
+    vector<ArrivalsChunk> chunks(pieces.size());
+    // On one node, hints would only make submit() wake every worker.
+    size_t nodes = threadPool().nodeCount();
+    function<size_t(size_t)> nodeOfPiece;
+    if (nodes > 1)
+        nodeOfPiece = [&](size_t i) { return i * nodes / pieces.size(); };
+    runParallel(
+        pieces.size(), [&](size_t i) { parseArrivalsChunk(pieces[i], json, chunks[i]); }, nodeOfPiece);
+
+    // Check weights in file order with one detector, keep the parsed chunks in place, and
+    // report their problem lines.
+    WeightAnomalyDetector detector;
+    ofstream reviewFile; // Opened on the first flagged record only.
+    for (auto& chunk : chunks) {
+        flagWeightAnomalies(detector, chunk);
+        for (const auto& line : chunk.invalid)
+            cerr << "Invalid record: " << line << endl;
+        for (const auto& line : chunk.flagged) {
+            if (!reviewFile.is_open())
+                reviewFile.open(reviewFilename, ios::app);
+            reviewFile << line << "\n";
+        }
+    }
+    for (size_t i = 0; i < chunks.size(); i++) {
+        animals.arenas.push_back(move(chunks[i].arena));
+        animals.chunks.push_back(move(chunks[i].animals));
+        if (nodes > 1)
+            animals.chunkNodes.push_back(i * nodes / chunks.size());
+    }
+    if (!file.mapped)
+        trackMemory(IntakeMemory, -static_cast<int64_t>(file.contents.capacity()));
+    return animals;
+}
+
+// Function to assign a random name to an animal based on its species.
+// The species is matched exactly, or case-insensitively if there is no exact match.
+// Returns "Unnamed" if no matching name is found. The view is valid until the next call on
+// the same thread (front-coded names are decoded into a thread-local buffer).
+string_view assignName(string_view species, const NamesTable& namesTable) {
+    NamesTable::Names names = namesTable.find(species);
+    if (!names.empty()) {
+        thread_local string decoded;
+        int index = rand() % names.size(); // Randomly choose one of the available names.
+        return names.get(index, decoded);
+    }
+    return "Unnamed"; // Return a default name if no match is found.
+}
+
+// Function to parse one line of the population report back into an Animal.
+// The line must have the eight comma-separated fields written by updateZooPopulation():
+// id, name, species, age, birth season, color, weight, origin.
+// Older reports without the id field (seven fields) are also accepted; their id is 0.
+// Lines starting with '{' are JSON Lines records as written in JsonLinesOutput format.
+// Returns false if the line does not match any of these layouts.
+bool parsePopulationRecord(const string& line, Animal& animal) {
+    size_t first = line.find_first_not_of(" \t");
+    if (first != string::npos && line[first] == '{')
+        return parseJsonAnimal(string_view(line).substr(first), animal);
+    vector<string> parts;
+    stringstream ss(line);
+    string part;
+    while(getline(ss, part, ',')) {
+        parts.push_back(trim(part));
+    }
+    if (parts.size() < 7)
+        return false;
+    first = 0;
+    animal.id = 0;
+    if (parts.size() >= 8) {
+        animal.id = strtoull(parts[0].c_str(), nullptr, 10);
+        first = 1;
+    }
+    animal.name = parts[first];
+    animal.species = parts[first + 1];
+    animal.age = atoi(parts[first + 2].c_str());
+    animal.birthSeason = parts[first + 3];
+    animal.color = parts[first + 4];
+    if (!parseWeight(parts[first + 5], animal.weight))
+        return false;
+    animal.origin = parts[first + 6];
+    return true;
+}
+
+// Function to stream every record of a population report through a callback.
+// Only one Animal is held in memory at a time, so this works on histories of any size.
+// Returns false if the file could not be opened.
+bool forEachPopulationRecord(const string& filename, const function<void(const Animal&)>& callback) {
+    ifstream file(filename);
+    if (!file) {
+        cerr << "Error opening file: " << filename << endl;
+        return false;
+    }
+    string line;
+    Animal animal;
+    while(getline(file, line)) {
+        if (trim(line).empty())
+            continue;
+        if (!parsePopulationRecord(line, animal)) {
+            cerr << "Invalid record: " << line << endl;
+            continue;
+        }
+        callback(animal);
+    }
+    return true;
+}
+
+// 64-bit hash of a string (FNV-1a followed by a splitmix64 finalizer so every bit is well mixed).
+uint64_t hash64(string_view text, uint64_t seed = 0) {
+    uint64_t h = 1469598103934665603ULL ^ seed;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// HyperLogLog sketch for estimating the number of distinct strings.
+// Uses 2^14 one-byte registers (16 KB) for a standard error of about 0.8%.
+// Two sketches built over different parts of the history can be merged.
+struct HyperLogLog {
+    static const int precision = 14;
+    vector<uint8_t> registers = vector<uint8_t>(size_t(1) << precision, 0);
+
+    void add(string_view value) {
+        uint64_t h = hash64(value);
+        size_t index = h >> (64 - precision);
+        uint64_t rest = (h << precision) | (uint64_t(1) << (precision - 1));
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if (rank > registers[index])
+            registers[index] = rank;
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < registers.size(); i++)
+            registers[i] = max(registers[i], other.registers[i]);
+    }
+
+    double estimate() const {
+        double m = static_cast<double>(registers.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += ldexp(1.0, -r);
+            if (r == 0)
+                zeros++;
+        }
+        double raw = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+        // Small cardinalities are estimated more accurately by linear counting.
+        if (raw <= 2.5 * m && zeros > 0)
+            return m * log(m / static_cast<double>(zeros));
+        return raw;
+    }
+};
+
+// Merging t-digest for estimating weight percentiles.
+// Values are buffered and periodically compressed into at most ~compression centroids,
+// kept small near the tails so extreme percentiles stay accurate.
+struct TDigest {
+    double compression = 100;
+    vector<pair<double, double>> centroids; // (mean, count), sorted by mean after compress()
+    vector<pair<double, double>> buffer;    // points not yet merged into the centroids
+    double totalCount = 0;
+
+    void add(double value, double count = 1) {
+        buffer.push_back({value, count});
+        totalCount += count;
+        if (buffer.size() >= static_cast<size_t>(compression * 5))
+            compress();
+    }
+
+    void merge(const TDigest& other) {
+        for (const auto& c : other.centroids)
+            add(c.first, c.second);
+        for (const auto& c : other.buffer)
+            add(c.first, c.second);
+    }
+
+    // Scale function k1: centroid sizes shrink towards q = 0 and q = 1.
+    double scale(double q) const {
+        return compression / (2 * M_PI) * asin(2 * q - 1);
+    }
+
+    void compress() {
+        if (buffer.empty())
+            return;
+        buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+        sort(buffer.begin(), buffer.end());
+        centroids.clear();
+        double soFar = 0;
+        pair<double, double> current = buffer[0];
+        double kLeft = scale(0);
+        for (size_t i = 1; i < buffer.size(); i++) {
+            double q = (soFar + current.second + buffer[i].second) / totalCount;
+            if (scale(q) - kLeft <= 1) {
+                // Fold the point into the current centroid.
+                current.second += buffer[i].second;
+                current.first += (buffer[i].first - current.first) * buffer[i].second / current.second;
+            } else {
+                soFar += current.second;
+                kLeft = scale(soFar / totalCount);
+                centroids.push_back(current);
+                current = buffer[i];
+            }
+        }
+        centroids.push_back(current);
+        buffer.clear();
+    }
+
+    // Returns the estimated value at quantile q (0..1), interpolating between centroid centres.
+    double quantile(double q) {
+        compress();
+        if (centroids.empty())
+            return 0;
+        if (centroids.size() == 1)
+            return centroids[0].first;
+        double target = q * totalCount;
+        double soFar = 0;
+        for (size_t i = 0; i < centroids.size(); i++) {
+            double mid = soFar + centroids[i].second / 2;
+            if (target < mid) {
+                if (i == 0)
+                    return centroids[0].first;
+                double prevMid = soFar - centroids[i - 1].second / 2;
+                double t = (target - prevMid) / (mid - prevMid);
+                return centroids[i - 1].first + t * (centroids[i].first - centroids[i - 1].first);
+            }
+            soFar += centroids[i].second;
+        }
+        return centroids.back().first;
+    }
+};
+
+// Sketches summarising the whole population history. They are persisted next to the
+// population report (e.g. "newAnimals.txt.sketch") and updated on every append,
+// so dashboard queries never need to rescan the report.
+struct PopulationSketches {
+    HyperLogLog names;
+    HyperLogLog origins;
+    TDigest weights;
+    uint64_t records = 0;
+
+    void add(const Animal& animal) {
+        names.add(animal.name);
+        origins.add(animal.origin);
+        weights.add(weightInPounds(animal.weight));
+        records++;
+    }
+
+    void merge(const PopulationSketches& other) {
+        names.merge(other.names);
+        origins.merge(other.origins);
+        weights.merge(other.weights);
+        records += other.records;
+    }
+};
+
+// Returns the sidecar filename that holds the sketches for a population report.
+string sketchFilename(const string& populationFile) {
+    return populationFile + ".sketch";
+}
+
+// Writes HyperLogLog registers as one hex string.
+void writeRegisters(ostream& out, const HyperLogLog& hll) {
+    static const char digits[] = "0123456789abcdef";
+    string hex;
+    hex.reserve(hll.registers.size() * 2);
+    for (uint8_t r : hll.registers) {
+        hex.push_back(digits[r >> 4]);
+        hex.push_back(digits[r & 15]);
+    }
+    out << hex << "\n";
+}
+
+bool readRegisters(istream& in, HyperLogLog& hll) {
+    string hex;
+    if (!(in >> hex) || hex.size() != hll.registers.size() * 2)
+        return false;
+    auto nibble = [](char c) { return c <= '9' ? c - '0' : c - 'a' + 10; };
+    for (size_t i = 0; i < hll.registers.size(); i++)
+        hll.registers[i] = static_cast<uint8_t>(nibble(hex[i * 2]) << 4 | nibble(hex[i * 2 + 1]));
+    return true;
+}
+
+// Function to save sketches to a text file.
+// Layout: record count, names registers, origins registers, then the weight centroids.
+bool saveSketches(const string& filename, PopulationSketches& sketches) {
+    ofstream file(filename);
+    if (!file) {
+        cerr << "Error opening file for writing: " << filename << endl;
+        return false;
+    }
+    sketches.weights.compress();
+    file.precision(17);
+    file << "records " << sketches.records << "\n";
+    file << "names ";
+    writeRegisters(file, sketches.names);
+    file << "origins ";
+    writeRegisters(file, sketches.origins);
+    file << "weights " << sketches.weights.compression << " " << sketches.weights.centroids.size();
+    for (const auto& c : sketches.weights.centroids)
+        file << " " << c.first << " " << c.second;
+    file << "\n";
+    return true;
+}
+
+// Function to load sketches saved by saveSketches().
+// Returns false if the file is missing or malformed.
+bool loadSketches(const string& filename, PopulationSketches& sketches) {
+    ifstream file(filename);
+    if (!file)
+        return false;
+    string label;
+    size_t centroidCount = 0;
+    PopulationSketches loaded;
+    if (!(file >> label >> loaded.records) || label != "records")
+        return false;
+    if (!(file >> label) || label != "names" || !readRegisters(file, loaded.names))
+        return false;
+    if (!(file >> label) || label != "origins" || !readRegisters(file, loaded.origins))
+        return false;
+    if (!(file >> label >> loaded.weights.compression >> centroidCount) || label != "weights")
+        return false;
+    for (size_t i = 0; i < centroidCount; i++) {
+        double mean, count;
+        if (!(file >> mean >> count))
+            return false;
+        loaded.weights.centroids.push_back({mean, count});
+        loaded.weights.totalCount += count;
+    }
+    sketches = loaded;
+    return true;
+}
+
+// Function to fold newly appended animals into the persisted sketches of a population report.
+// If no sketch exists yet, it is first built from the records already in the report
+// so the sketches always describe the full history.
+void updatePopulationSketches(const string& populationFile, const ArrivingAnimals& animals) {
+    TraceScope trace("update sketches");
+    PopulationSketches sketches;
+    string filename = sketchFilename(populationFile);
+    if (!loadSketches(filename, sketches)) {
+        ifstream existing(populationFile);
+        if (existing) {
+            existing.close();
+            forEachPopulationRecord(populationFile, [&sketches](const Animal& animal) { sketches.add(animal); });
+        }
+    }
+    for (const auto& animal : animals)
+        sketches.add(animal);
+    saveSketches(filename, sketches);
+}
+
+// Output formats for the population report.
+enum OutputFormat {
+    CsvOutput,       // One comma-separated line per animal (the default).
+    JsonLinesOutput  // One JSON object per line.
+};
+
+// Function to append an integer in decimal without going through a stream.
+void appendInteger(string& out, int64_t value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+// Function to append one animal as a CSV report line:
+// id, name, species, age, birth season, color, weight, origin.
+void appendCsvRecord(string& out, const Animal& animal) {
+    appendInteger(out, static_cast<int64_t>(animal.id));
+    out += ", ";
+    out += animal.name;
+    out += ", ";
+    out += animal.species;
+    out += ", ";
+    appendInteger(out, animal.age);
+    out += ", ";
+    out += animal.birthSeason;
+    out += ", ";
+    out += animal.color;
+    out += ", ";
+    appendWeight(out, animal.weight);
+    out += ", ";
+    out += animal.origin;
+    out += '\n';
+}
+
+// Function to append a string as a quoted JSON string.
+// Runs of characters that need no escaping are copied in one append; only quotes,
+// backslashes and control characters are escaped.
+void appendJsonString(string& out, string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    size_t runStart = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        out.append(text.data() + runStart, i - runStart);
+        out.push_back('\\');
+        switch (c) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '\n': out.push_back('n'); break;
+            case '\r': out.push_back('r'); break;
+            case '\t': out.push_back('t'); break;
+            default:
+                out += "u00";
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 15]);
+        }
+        runStart = i + 1;
+    }
+    out.append(text.data() + runStart, text.size() - runStart);
+    out.push_back('"');
+}
+
+// Function to append one animal as a JSON Lines record, e.g.
+// {"id":1,"name":"Zig","species":"Hyena","age":4,"birthSeason":"born in spring",
+//  "color":"tan color","weight":70,"origin":"from Friguia Park Tanzania"}
+// The weight is written as an exact decimal number of pounds.
+void appendJsonRecord(string& out, const Animal& animal) {
+    out += "{\"id\":";
+    appendInteger(out, static_cast<int64_t>(animal.id));
+    out += ",\"name\":";
+    appendJsonString(out, animal.name);
+    out += ",\"species\":";
+    appendJsonString(out, animal.species);
+    out += ",\"age\":";
+    appendInteger(out, animal.age);
+    out += ",\"birthSeason\":";
+    appendJsonString(out, animal.birthSeason);
+    out += ",\"color\":";
+    appendJsonString(out, animal.color);
+    out += ",\"weight\":";
+    appendWeight(out, animal.weight);
+    out += ",\"origin\":";
+    appendJsonString(out, animal.origin);
+    out += "}\n";
+}
+
+// Function to append data to a file with O_DIRECT, bypassing the page cache so large
+// report appends do not evict data the next intake needs.
+// O_DIRECT needs block-aligned buffers, offsets and lengths, so writing starts at the last
+// block boundary of the file (re-writing the existing partial tail block), goes through an
+// aligned staging buffer, pads the final block and then truncates the file to its real size.
+// Returns false without writing anything if the filesystem refuses O_DIRECT, so the caller
+// can fall back to a normal write.
+bool appendDirect(const string& filename, string_view data) {
+#if defined(__linux__) && defined(O_DIRECT)
+    const size_t block = 4096;
+    const size_t stagingSize = 4 * 1024 * 1024;
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_DIRECT, 0644);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    size_t offset = fileSize & ~(block - 1);
+    void* memory = nullptr;
+    if (posix_memalign(&memory, block, stagingSize) != 0) {
+        ::close(fd);
+        return false;
+    }
+    char* staging = static_cast<char*>(memory);
+    trackMemory(OutputMemory, stagingSize);
+    // Start with the existing partial block at the end of the file (read through the page cache).
+    size_t filled = fileSize - offset;
+    bool ok = true;
+    if (filled > 0) {
+        int readFd = ::open(filename.c_str(), O_RDONLY);
+        ok = readFd >= 0 && pread(readFd, staging, filled, static_cast<off_t>(offset)) == static_cast<ssize_t>(filled);
+        if (readFd >= 0)
+            ::close(readFd);
+    }
+    bool wroteAnything = false;
+    size_t consumed = 0;
+    while (ok && (consumed < data.size() || filled > 0)) {
+        size_t take = min(stagingSize - filled, data.size() - consumed);
+        memcpy(staging + filled, data.data() + consumed, take);
+        filled += take;
+        consumed += take;
+        bool last = consumed == data.size();
+        // Write whole blocks; on the last round pad the final partial block with zeros.
+        size_t writable = last ? (filled + block - 1) & ~(block - 1) : filled & ~(block - 1);
+        memset(staging + filled, 0, writable - min(writable, filled));
+        ssize_t written = pwrite(fd, staging, writable, static_cast<off_t>(offset));
+        if (written != static_cast<ssize_t>(writable)) {
+            ok = false;
+            break;
+        }
+        wroteAnything = true;
+        offset += writable;
+        size_t carry = last ? 0 : filled - writable;
+        memmove(staging, staging + writable, carry);
+        filled = carry;
+    }
+    if (wroteAnything) {
+        // Drop the zero padding; with a failed write, restore the original length.
+        off_t finalSize = static_cast<off_t>(ok ? fileSize + data.size() : fileSize);
+        if (ftruncate(fd, finalSize) != 0)
+            ok = false;
+    }
+    free(memory);
+    trackMemory(OutputMemory, -static_cast<int64_t>(stagingSize));
+    ::close(fd);
+    if (!ok && wroteAnything)
+        cerr << "Direct write to " << filename << " failed: " << strerror(errno) << endl;
+    return ok;
+#else
+    (void)filename;
+    (void)data;
+    return false;
+#endif
+}
+
+// Function to update the animal report file by appending new animal records.
+// In CSV format each line has the fields:
+// id, name, species, age, birth season, color, weight, origin.
+// In JSON Lines format each line is one object with the same fields (see appendJsonRecord()).
+// Records are formatted into one buffer and written with a single call.
+// With directIO the buffer is written with O_DIRECT (see appendDirect()), falling back to a
+// normal buffered write when the filesystem does not support it.
+// Note: The output report file is now "newAnimals.txt" instead of "zooPopulation.txt".
+void updateZooPopulation(const string& filename, const ArrivingAnimals& animals, OutputFormat format = CsvOutput,
+                         bool directIO = false) {
+    // Fold the new records into the history sketches before they hit the report,
+    // so a first-time sketch rebuild does not count them twice.
+    updatePopulationSketches(filename, animals);
+    // Format every animal into the output buffer, then write it out at once.
+    TraceScope trace("write flush");
+    string buffer;
+    buffer.reserve(animals.size() * 128);
+    for (const auto& animal : animals) {
+        if (format == JsonLinesOutput)
+            appendJsonRecord(buffer, animal);
+        else
+            appendCsvRecord(buffer, animal);
+    }
+    trackMemory(OutputMemory, static_cast<int64_t>(buffer.capacity()));
+    if (!directIO || !appendDirect(filename, buffer)) {
+        // Open the file in append mode.
+        ofstream file(filename, ios::app | ios::binary);
+        if (!file)
+            cerr << "Error opening file for writing: " << filename << endl;
+        else
+            file.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    }
+    trackMemory(OutputMemory, -static_cast<int64_t>(buffer.capacity()));
+}
+
+// Returns a population report's filename without its extension ("newAnimals" for both
+// "newAnimals.txt" and "newAnimals.jsonl").
+string reportStem(const string& populationFile) {
+    size_t dot = populationFile.rfind('.');
+    size_t slash = populationFile.rfind('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return populationFile;
+    return populationFile.substr(0, dot);
+}
+
+// Returns the sidecar filename that holds the next free animal ID for a population report.
+// The text and JSON Lines reports share one counter ("newAnimals.nextid"), so an ID is
+// never handed out in both.
+string idFilename(const string& populationFile) {
+    return reportStem(populationFile) + ".nextid";
+}
+
+// Function to give each arriving animal a stable, monotonically increasing 64-bit ID.
+// The next free ID is kept next to the population reports (see idFilename()).
+// If that file is missing, the report and its sibling in the other format are scanned once
+// for the highest ID already used; per-report counters from older versions
+// ("newAnimals.txt.nextid") are honoured too.
+// The new counter is saved before returning, so IDs are never reused even if the
+// report is not written afterwards.
+void assignAnimalIds(const string& populationFile, ArrivingAnimals& animals) {
+    uint64_t nextId = 1;
+    ifstream idFile(idFilename(populationFile));
+    if (!(idFile >> nextId)) {
+        nextId = 1;
+        string stem = reportStem(populationFile);
+        vector<string> reports = {populationFile};
+        for (const char* extension : {".txt", ".jsonl"})
+            if (stem + extension != populationFile)
+                reports.push_back(stem + extension);
+        for (const auto& report : reports) {
+            uint64_t legacyNextId = 0;
+            if (ifstream(report + ".nextid") >> legacyNextId)
+                nextId = max(nextId, legacyNextId);
+            ifstream existing(report);
+            if (existing) {
+                existing.close();
+                forEachPopulationRecord(report, [&nextId](const Animal& animal) {
+                    nextId = max(nextId, animal.id + 1);
+                });
+            }
+        }
+    }
+    idFile.close();
+    for (auto& animal : animals)
+        animal.id = nextId++;
+    ofstream out(idFilename(populationFile));
+    if (!out) {
+        cerr << "Error opening file for writing: " << idFilename(populationFile) << endl;
+        return;
+    }
+    out << nextId << "\n";
+}
+
+// In-memory population with an ID -> row index, so lookups by ID are O(1).
+// IDs are handed out consecutively, so the index is mostly a plain vector offset by the
+// smallest ID. An ID that would stretch the vector beyond a few slots per row (a far-off or
+// hand-edited ID) goes to a hash map instead, so sparse reports cannot exhaust memory.
+struct PopulationTable {
+    vector<Animal> rows;
+    uint64_t firstId = 0;
+    vector<int64_t> rowById;                    // rowById[id - firstId] is the row of that ID, or -1
+    unordered_map<uint64_t, size_t> sparseRows; // IDs outside the dense range
+
+    void add(const Animal& animal) {
+        rows.push_back(animal);
+        if (animal.id == 0)
+            return; // Legacy records without an ID are not indexed.
+        size_t row = rows.size() - 1;
+        uint64_t id = animal.id;
+        if (rowById.empty()) {
+            firstId = id;
+            rowById.push_back(static_cast<int64_t>(row));
+            sparseRows.erase(id);
+            return;
+        }
+        uint64_t low = min(id, firstId);
+        uint64_t high = max(id, firstId + rowById.size() - 1);
+        if (high - low >= 1024 + 4 * static_cast<uint64_t>(rows.size())) {
+            sparseRows[id] = row;
+            return;
+        }
+        if (id < firstId) {
+            // Grow the index at the front (only happens for out-of-order input).
+            rowById.insert(rowById.begin(), firstId - id, -1);
+            firstId = id;
+        }
+        size_t slot = id - firstId;
+        if (slot >= rowById.size())
+            rowById.resize(slot + 1, -1);
+        rowById[slot] = static_cast<int64_t>(row);
+        sparseRows.erase(id);
+    }
+
+    // Returns the animal with the given ID, or nullptr if it is not in the table.
+    Animal* find(uint64_t id) {
+        if (id >= firstId && id - firstId < rowById.size() && rowById[id - firstId] >= 0)
+            return &rows[rowById[id - firstId]];
+        auto it = sparseRows.find(id);
+        return it == sparseRows.end() ? nullptr : &rows[it->second];
+    }
+};
+
+// Case-insensitive prefix and substring search over animal names.
+// All names are lower-cased into one text buffer, each ended by '\n', and a suffix array
+// lists every position of that text ordered by the suffix starting there (compared only up
+// to the end of its name). A query is two binary searches for the block of suffixes that
+// start with it, so it costs O(|query| log n) plus the number of matches.
+class NameSearchIndex {
+    string text;                // Lower-cased names, each followed by '\n'
+    vector<uint32_t> nameStarts; // Start of each name in text, by row
+    vector<uint32_t> suffixes;  // Positions in text, in suffix order
+
+    static string lowered(string_view value) {
+        string result(value);
+        for (char& c : result)
+            c = static_cast<char>(asciiLower(c));
+        return result;
+    }
+
+    // The suffix starting at pos, up to the end of its name.
+    string_view suffix(uint32_t pos) const {
+        const char* start = text.data() + pos;
+        const char* end = static_cast<const char*>(memchr(start, '\n', text.size() - pos));
+        return string_view(start, end - start);
+    }
+
+public:
+    // Builds the index over the names of rows; search() returns indexes into rows.
+    void build(const vector<Animal>& rows) {
+        TraceScope trace("build name index");
+        text.clear();
+        nameStarts.clear();
+        for (const auto& animal : rows) {
+            nameStarts.push_back(static_cast<uint32_t>(text.size()));
+            text += lowered(animal.name);
+            text += '\n';
+        }
+        // Sort on the first 8 bytes of each suffix packed into an integer; only ties
+        // compare the rest of the suffix.
+        vector<pair<uint64_t, uint32_t>> keyed;
+        keyed.reserve(text.size() - rows.size());
+        for (uint32_t pos = 0; pos < text.size(); pos++) {
+            if (text[pos] == '\n')
+                continue;
+            uint64_t key = 0;
+            bool ended = false;
+            for (uint32_t k = 0; k < 8; k++) {
+                ended = ended || text[pos + k] == '\n';
+                key = key << 8 | (ended ? 0 : static_cast<unsigned char>(text[pos + k]));
+            }
+            keyed.emplace_back(key, pos);
+        }
+        auto less = [this](const pair<uint64_t, uint32_t>& a, const pair<uint64_t, uint32_t>& b) {
+            if (a.first != b.first)
+                return a.first < b.first;
+            int order = suffix(a.second).compare(suffix(b.second));
+            return order != 0 ? order < 0 : a.second < b.second;
+        };
+        // Sort slices on the thread pool, then merge neighbouring slices pairwise.
+        size_t slices = min<size_t>(parallelism(), max<size_t>(1, keyed.size() / 65536));
+        vector<size_t> bounds;
+        for (size_t i = 0; i <= slices; i++)
+            bounds.push_back(keyed.size() * i / slices);
+        runParallel(slices, [&](size_t i) { sort(keyed.begin() + bounds[i], keyed.begin() + bounds[i + 1], less); });
+        for (size_t width = 1; width < slices; width *= 2) {
+            runParallel((slices + 2 * width - 1) / (2 * width), [&](size_t i) {
+                size_t first = 2 * width * i;
+                size_t middle = min(first + width, slices);
+                size_t last = min(first + 2 * width, slices);
+                inplace_merge(keyed.begin() + bounds[first], keyed.begin() + bounds[middle],
+                              keyed.begin() + bounds[last], less);
+            });
+        }
+        suffixes.resize(keyed.size());
+        for (size_t i = 0; i < keyed.size(); i++)
+            suffixes[i] = keyed[i].second;
+    }
+
+    // Returns the rows whose name contains query (or starts with it, with prefixOnly),
+    // in ascending order.
+    vector<size_t> search(string_view query, bool prefixOnly) const {
+        string needle = lowered(query);
+        auto first = lower_bound(suffixes.begin(), suffixes.end(), needle, [this](uint32_t pos, const string& q) {
+            return suffix(pos).substr(0, q.size()) < q;
+        });
+        auto last = upper_bound(first, suffixes.end(), needle, [this](const string& q, uint32_t pos) {
+            return q < suffix(pos).substr(0, q.size());
+        });
+        vector<size_t> rows;
+        for (auto it = first; it != last; ++it) {
+            size_t row = upper_bound(nameStarts.begin(), nameStarts.end(), *it) - nameStarts.begin() - 1;
+            if (!prefixOnly || nameStarts[row] == *it)
+                rows.push_back(row);
+        }
+        // A name can contain the query more than once.
+        sort(rows.begin(), rows.end());
+        rows.erase(unique(rows.begin(), rows.end()), rows.end());
+        return rows;
+    }
+
+    // Heap bytes owned by the index.
+    size_t bytes() const {
+        return text.capacity() + (nameStarts.capacity() + suffixes.capacity()) * sizeof(uint32_t);
+    }
+};
+
+
+// Splits (key, payload) records into buckets by the hash of the key, so matching keys
+// from two inputs always land in the same bucket and buckets can be processed independently.
+// Buckets are kept in memory, or spilled to temporary files when a spill prefix is given
+// so inputs larger than memory can still be processed one bucket at a time.
+// Spill errors are printed and make finish() and forEach() return false.
+struct HashPartitioner {
+    static const char separator = '\x1f'; // Between key and payload in spill files.
+    string spillPrefix;
+    vector<vector<pair<string, string>>> memory;
+    vector<ofstream> files;
+    bool failed = false; // A spill file could not be opened or written.
+
+    HashPartitioner(size_t partitionCount, const string& spillPrefix = "") : spillPrefix(spillPrefix) {
+        if (spillPrefix.empty()) {
+            memory.resize(partitionCount);
+        } else {
+            for (size_t i = 0; i < partitionCount; i++) {
+                files.emplace_back(partitionFilename(i));
+                if (!files.back() && !failed) {
+                    cerr << "Error opening file for writing: " << partitionFilename(i) << " (" << strerror(errno)
+                         << ")" << endl;
+                    failed = true;
+                }
+            }
+        }
+    }
+
+    ~HashPartitioner() {
+        for (size_t i = 0; i < files.size(); i++) {
+            files[i].close();
+            remove(partitionFilename(i).c_str());
+        }
+    }
+
+    size_t partitionCount() const {
+        return spillPrefix.empty() ? memory.size() : files.size();
+    }
+
+    string partitionFilename(size_t partition) const {
+        return spillPrefix + "." + to_string(partition);
+    }
+
+    void add(const string& key, const string& payload) {
+        size_t partition = hash64(key) % partitionCount();
+        if (spillPrefix.empty())
+            memory[partition].push_back({key, payload});
+        else
+            files[partition] << key << separator << payload << "\n";
+    }
+
+    // Must be called once all records are added and before forEach(). Closes the spill files
+    // (so their descriptors are free while partitions are read) and returns false if any
+    // of them failed.
+    bool finish() {
+        for (size_t i = 0; i < files.size(); i++) {
+            files[i].close();
+            if (files[i].fail() && !failed) {
+                cerr << "Error writing file: " << partitionFilename(i) << endl;
+                failed = true;
+            }
+        }
+        return !failed;
+    }
+
+    // Calls back with every record of one partition. Safe to call for different partitions in parallel.
+    // Returns false if the partition's spill file cannot be read.
+    bool forEach(size_t partition, const function<void(const string& key, const string& payload)>& callback) const {
+        if (spillPrefix.empty()) {
+            for (const auto& record : memory[partition])
+                callback(record.first, record.second);
+            return true;
+        }
+        ifstream file(partitionFilename(partition));
+        if (!file) {
+            cerr << "Error opening file: " << partitionFilename(partition) << endl;
+            return false;
+        }
+        string line;
+        while (getline(file, line)) {
+            size_t split = line.find(separator);
+            if (split != string::npos)
+                callback(line.substr(0, split), line.substr(split + 1));
+        }
+        return !file.bad();
+    }
+};
+
+// Returns the size of a file in bytes, or 0 if it cannot be determined.
+uintmax_t fileSizeOrZero(const string& filename) {
+    error_code error;
+    uintmax_t size = filesystem::file_size(filename, error);
+    return error ? 0 : size;
+}
+
+// Returns how many spill files each side of a two-input partitioning may keep open:
+// at most 512, and half of the open-file limit minus some descriptors kept for the
+// inputs and standard streams.
+size_t maxSpillPartitions() {
+    size_t limit = 512;
+#ifdef __unix__
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY) {
+        rlim_t available = files.rlim_cur > 64 ? (files.rlim_cur - 64) / 2 : 1;
+        limit = static_cast<size_t>(min<rlim_t>(limit, available));
+    }
+#endif
+    return limit;
+}
+
+// Chooses how many hash partitions to use for inputs of totalSize bytes.
+// In memory there is one partition per thread. When spilling, partitions are sized so that
+// every thread's partition, including hash table overhead (about 4x the raw record size),
+// fits in the budget together; the count is capped by maxSpillPartitions(). Past that cap
+// partitions are not split again, so inputs that need more partitions can exceed the budget.
+size_t partitionCountFor(uintmax_t totalSize, uintmax_t memoryBudget) {
+    size_t threads = parallelism();
+    if (totalSize * 4 <= memoryBudget)
+        return threads;
+    const size_t maxPartitions = maxSpillPartitions();
+    uintmax_t wanted = totalSize * 4 * threads / max<uintmax_t>(memoryBudget, 1) + 1;
+    return static_cast<size_t>(min<uintmax_t>(max<uintmax_t>(wanted, threads), max<size_t>(maxPartitions, 1)));
+}
+
+// Returns a unique prefix for temporary spill files. The process ID keeps runs started in
+// the same second apart; the counter keeps calls within one run apart.
+string temporarySpillPrefix(const string& purpose) {
+    static atomic<unsigned> counter(0);
+#ifdef __unix__
+    string process = to_string(getpid());
+#else
+    string process = to_string(time(NULL));
+#endif
+    return (filesystem::temp_directory_path() / ("zoo-" + purpose + "-" + process + "-" + to_string(counter++)))
+        .string();
+}
+
+// Returns the key that identifies the same animal in two snapshots: the stable ID when present.
+// Records written before IDs existed use name and species plus how many times that pair
+// was already seen in the file, so the n-th "Simba, Lion" of one snapshot is matched
+// with the n-th "Simba, Lion" of the other.
+string recordKey(const Animal& animal, unordered_map<string, size_t>& seenWithoutId) {
+    if (animal.id != 0)
+        return to_string(animal.id);
+    string key = animal.name.str() + "|";
+    key += animal.species;
+    return key + "#" + to_string(seenWithoutId[key]++);
+}
+
+// Returns the record in one canonical CSV form, so whitespace or weight formatting
+// differences between two files do not count as changes.
+string normalizeRecord(const Animal& animal) {
+    string line = to_string(animal.id) + ", ";
+    line.append(animal.name.view()).append(", ").append(animal.species.view()).append(", ");
+    line += to_string(animal.age) + ", ";
+    line.append(animal.birthSeason.view()).append(", ").append(animal.color.view()).append(", ");
+    appendWeight(line, animal.weight);
+    line.append(", ").append(animal.origin.view());
+    return line;
+}
+
+// Differences found in one partition of two population snapshots.
+struct PopulationDiff {
+    vector<string> added;
+    vector<string> removed;
+    vector<pair<string, string>> changed; // (old record, new record)
+};
+
+// Function to compare two population reports in linear time.
+// Both files are hash-partitioned by record key; each partition is then diffed on its own
+// (in parallel) with a hash table built from the old side. Held in memory, records, keys and
+// hash tables take about 4x the size of the files. When that is more than memoryBudget bytes
+// the partitions are spilled to temporary files, so only one partition per thread needs to be
+// in memory at once (very large inputs can still exceed the budget, see partitionCountFor()). The differences of each partition are passed to
+// emit as soon as it is done (one call at a time) and then freed, so results do not pile up.
+// Returns false, after printing the error, if an input or spill file cannot be read or written.
+bool diffPopulations(const string& oldFile, const string& newFile, uintmax_t memoryBudget,
+                     const function<void(const PopulationDiff&)>& emit) {
+    uintmax_t totalSize = fileSizeOrZero(oldFile) + fileSizeOrZero(newFile);
+    bool spill = totalSize * 4 > memoryBudget;
+    size_t partitions = partitionCountFor(totalSize, memoryBudget);
+    HashPartitioner oldSide(partitions, spill ? temporarySpillPrefix("diff-old") : "");
+    HashPartitioner newSide(partitions, spill ? temporarySpillPrefix("diff-new") : "");
+    if (oldSide.failed || newSide.failed)
+        return false;
+    unordered_map<string, size_t> oldSeen, newSeen;
+    bool read = forEachPopulationRecord(oldFile, [&](const Animal& animal) {
+        oldSide.add(recordKey(animal, oldSeen), normalizeRecord(animal));
+    });
+    read = read && forEachPopulationRecord(newFile, [&](const Animal& animal) {
+        newSide.add(recordKey(animal, newSeen), normalizeRecord(animal));
+    });
+    bool finished = oldSide.finish();
+    finished = newSide.finish() && finished;
+    if (!read || !finished)
+        return false;
+
+    mutex emitLock;
+    atomic<bool> ok(true);
+    runParallel(partitions, [&](size_t partition) {
+        TraceScope trace("diff partition");
+        PopulationDiff result;
+        unordered_map<string, pair<string, bool>> oldRecords; // key -> (record, matched)
+        bool readOld = oldSide.forEach(partition, [&oldRecords](const string& key, const string& record) {
+            oldRecords[key] = {record, false};
+        });
+        bool readNew = newSide.forEach(partition, [&](const string& key, const string& record) {
+            auto it = oldRecords.find(key);
+            if (it == oldRecords.end()) {
+                result.added.push_back(record);
+                return;
+            }
+            it->second.second = true;
+            if (it->second.first != record)
+                result.changed.push_back({it->second.first, record});
+        });
+        if (!readOld || !readNew) {
+            ok = false;
+            return;
+        }
+        for (const auto& pair : oldRecords) {
+            if (!pair.second.second)
+                result.removed.push_back(pair.second.first);
+        }
+        lock_guard<mutex> guard(emitLock);
+        emit(result);
+    });
+    return ok;
+}
+
+// Returns the key used to match population records with veterinary records:
+// name and species, compared case-insensitively.
+string joinKey(string_view name, string_view species) {
+    string key(name);
+    key += '|';
+    key += species;
+    for (char& c : key)
+        c = static_cast<char>(asciiLower(c));
+    return key;
+}
+
+// Function to read one CSV field starting at pos, with RFC 4180 quoting: a field in double
+// quotes may contain commas, and "" inside it stands for one quote. Surrounding spaces are
+// trimmed. On return pos is at the comma after the field, or at the end of the line.
+// Returns false for an unterminated quote or text after the closing quote; quoted fields
+// spanning several lines are not supported.
+bool readCsvField(const string& line, size_t& pos, string& field) {
+    field.clear();
+    while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+        pos++;
+    if (pos < line.size() && line[pos] == '"') {
+        for (pos++;; pos++) {
+            if (pos >= line.size())
+                return false;
+            if (line[pos] == '"') {
+                if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                    field += '"';
+                    pos++;
+                    continue;
+                }
+                break;
+            }
+            field += line[pos];
+        }
+        pos++;
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r'))
+            pos++;
+        return pos == line.size() || line[pos] == ',';
+    }
+    size_t comma = line.find(',', pos);
+    size_t end = comma == string::npos ? line.size() : comma;
+    field = trim(line.substr(pos, end - pos));
+    pos = end;
+    return true;
+}
+
+// Function to stream one side of a join as (key, payload) pairs.
+// Population reports yield the normalized record; veterinary CSVs have name and species
+// in their first two fields (which may be quoted, see readCsvField()) and yield the remaining
+// fields as written. A vet header line is skipped.
+bool forEachJoinRecord(const string& filename, bool isPopulation,
+                       const function<void(const string& key, const string& payload)>& callback) {
+    if (isPopulation) {
+        return forEachPopulationRecord(filename, [&callback](const Animal& animal) {
+            callback(joinKey(animal.name, animal.species), normalizeRecord(animal));
+        });
+    }
+    ifstream file(filename);
+    if (!file) {
+        cerr << "Error opening file: " << filename << endl;
+        return false;
+    }
+    string line, name, species;
+    while (getline(file, line)) {
+        size_t pos = 0;
+        bool hasSpecies = readCsvField(line, pos, name) && pos < line.size();
+        if (hasSpecies)
+            hasSpecies = readCsvField(line, ++pos, species);
+        if (!hasSpecies) {
+            if (!trim(line).empty())
+                cerr << "Invalid record: " << line << endl;
+            continue;
+        }
+        string key = joinKey(name, species);
+        if (key == "name|species")
+            continue; // Header line.
+        callback(key, pos < line.size() ? trim(line.substr(pos + 1)) : "");
+    }
+    return true;
+}
+
+// Function to join a population report with a veterinary CSV on name and species.
+// The smaller file is loaded into a hash table and the larger one is streamed past it in
+// batches that are probed in parallel. When the smaller file does not fit in memoryBudget
+// bytes, both sides are hash-partitioned to temporary files first (grace hash join) and
+// each partition pair is joined on its own. Every match is passed to emit as
+// (population record, vet fields) in no particular order; emit is only ever called from one
+// thread at a time.
+// Returns false, after printing the error, if an input or spill file cannot be read or written.
+bool hashJoinVetRecords(const string& populationFile, const string& vetFile, uintmax_t memoryBudget,
+                        const function<void(const string&, const string&)>& emit) {
+    uintmax_t populationSize = fileSizeOrZero(populationFile);
+    uintmax_t vetSize = fileSizeOrZero(vetFile);
+    bool buildOnPopulation = populationSize < vetSize;
+    const string& buildFile = buildOnPopulation ? populationFile : vetFile;
+    const string& probeFile = buildOnPopulation ? vetFile : populationFile;
+    // Orders a (build, probe) match as (population, vet).
+    auto ordered = [buildOnPopulation](const string& built, const string& probed) {
+        return buildOnPopulation ? make_pair(built, probed) : make_pair(probed, built);
+    };
+    // Hash table overhead is roughly 4x the raw record size.
+    uintmax_t buildSize = min(populationSize, vetSize);
+    // Each task hands its matches to emit in small batches, so the join output is never
+    // held in memory as a whole.
+    mutex emitLock;
+    struct MatchBuffer {
+        const function<void(const string&, const string&)>& emit;
+        mutex& lock;
+        vector<pair<string, string>> matches;
+
+        MatchBuffer(const function<void(const string&, const string&)>& emitter, mutex& emitLock)
+            : emit(emitter), lock(emitLock) {}
+        ~MatchBuffer() {
+            flush();
+        }
+        void add(pair<string, string> match) {
+            matches.push_back(move(match));
+            if (matches.size() == 4096)
+                flush();
+        }
+        void flush() {
+            if (matches.empty())
+                return;
+            lock_guard<mutex> guard(lock);
+            for (const auto& match : matches)
+                emit(match.first, match.second);
+            matches.clear();
+        }
+    };
+
+    if (buildSize * 4 <= memoryBudget) {
+        unordered_map<string, vector<string>> table;
+        if (!forEachJoinRecord(buildFile, buildOnPopulation, [&table](const string& key, const string& payload) {
+                table[key].push_back(payload);
+            }))
+            return false;
+        const size_t batchSize = 65536;
+        const size_t chunkSize = 4096;
+        vector<pair<string, string>> batch;
+        auto probeBatch = [&]() {
+            size_t chunks = (batch.size() + chunkSize - 1) / chunkSize;
+            runParallel(chunks, [&](size_t chunk) {
+                TraceScope trace("join probe chunk");
+                MatchBuffer matches(emit, emitLock);
+                size_t end = min(batch.size(), (chunk + 1) * chunkSize);
+                for (size_t i = chunk * chunkSize; i < end; i++) {
+                    auto it = table.find(batch[i].first);
+                    if (it == table.end())
+                        continue;
+                    for (const auto& built : it->second)
+                        matches.add(ordered(built, batch[i].second));
+                }
+            });
+            batch.clear();
+        };
+        bool read = forEachJoinRecord(probeFile, !buildOnPopulation, [&](const string& key, const string& payload) {
+            batch.push_back({key, payload});
+            if (batch.size() == batchSize)
+                probeBatch();
+        });
+        probeBatch();
+        return read;
+    }
+
+    // Grace hash join: partition both sides so each build partition fits in memory.
+    size_t partitions = partitionCountFor(buildSize, memoryBudget / 4);
+    HashPartitioner buildSide(partitions, temporarySpillPrefix("join-build"));
+    HashPartitioner probeSide(partitions, temporarySpillPrefix("join-probe"));
+    if (buildSide.failed || probeSide.failed)
+        return false;
+    bool read = forEachJoinRecord(buildFile, buildOnPopulation, [&buildSide](const string& key, const string& payload) {
+        buildSide.add(key, payload);
+    });
+    read = read && forEachJoinRecord(probeFile, !buildOnPopulation,
+                                     [&probeSide](const string& key, const string& payload) {
+                                         probeSide.add(key, payload);
+                                     });
+    bool finished = buildSide.finish();
+    finished = probeSide.finish() && finished;
+    if (!read || !finished)
+        return false;
+    atomic<bool> ok(true);
+    runParallel(partitions, [&](size_t partition) {
+        TraceScope trace("join partition");
+        MatchBuffer matches(emit, emitLock);
+        unordered_map<string, vector<string>> table;
+        if (!buildSide.forEach(partition, [&table](const string& key, const string& payload) {
+                table[key].push_back(payload);
+            }))
+            ok = false;
+        bool readProbe = probeSide.forEach(partition, [&](const string& key, const string& payload) {
+            auto it = table.find(key);
+            if (it == table.end())
+                return;
+            for (const auto& built : it->second)
+                matches.add(ordered(built, payload));
+        });
+        if (!readProbe)
+            ok = false;
+    });
+    return ok;
+}
+
+// Per-species name pools for assigning names from several threads at once.
+// Each pool is a shuffled array of the species' distinct names plus an atomic cursor:
+// a thread claims the next name with one fetch_add, so no locks are needed and no two
+// animals can get the same slot. Once a pool runs out, names are reused with a numeric
+// suffix ("Simba 2", "Simba 3", ...), so names handed out in one run stay unique.
+// Pools are indexed like the species of the NamesTable, which must outlive them.
+struct NamePools {
+    struct Pool {
+        NamesTable::Names names;
+        vector<uint32_t> order; // Indexes of the distinct names, shuffled
+        atomic<uint64_t> cursor{0};
+    };
+    const NamesTable& table;
+    vector<unique_ptr<Pool>> pools;
+
+    NamePools(const NamesTable& namesTable, uint64_t seed) : table(namesTable) {
+        mt19937_64 random(seed);
+        for (size_t i = 0; i < table.size(); i++) {
+            auto pool = make_unique<Pool>();
+            const NamesTable::Names& names = pool->names = table.names(i);
+            vector<uint32_t>& order = pool->order;
+            for (size_t j = 0; j < names.size(); j++)
+                order.push_back(static_cast<uint32_t>(j));
+            // Front-coded pools are already sorted; small plain pools are sorted here.
+            string left, right; // Decode buffers, so comparisons do not allocate.
+            auto nameLess = [&](uint32_t a, uint32_t b) { return names.get(a, left) < names.get(b, right); };
+            auto nameEqual = [&](uint32_t a, uint32_t b) { return names.get(a, left) == names.get(b, right); };
+            if (!names.sorted())
+                sort(order.begin(), order.end(), nameLess);
+            order.erase(unique(order.begin(), order.end(), nameEqual), order.end());
+            shuffle(order.begin(), order.end(), random);
+            pools.push_back(move(pool));
+        }
+    }
+
+    // Claims the next unused name of a species. Safe to call from any number of threads.
+    // The view is valid until the next call on the same thread.
+    string_view take(string_view species) const {
+        long index = table.indexOf(species);
+        if (index < 0 || pools[index]->order.empty())
+            return "Unnamed";
+        Pool& pool = *pools[index];
+        uint64_t slot = pool.cursor.fetch_add(1, memory_order_relaxed);
+        thread_local string decoded, numbered;
+        string_view name = pool.names.get(pool.order[slot % pool.order.size()], decoded);
+        uint64_t round = slot / pool.order.size();
+        if (round == 0)
+            return name;
+        char suffix[24];
+        auto suffixEnd = to_chars(suffix, suffix + sizeof(suffix), round + 1).ptr;
+        numbered.assign(name);
+        numbered += ' ';
+        numbered.append(suffix, suffixEnd);
+        return numbered;
+    }
+};
+
+// Function to name every animal in parallel from the species name pools.
+// Animals are split into batches that worker threads claim one at a time.
+void assignNamesParallel(ArrivingAnimals& animals, const NamePools& pools) {
+    animals.parallelBatches(4096, [&](Animal* first, Animal* last) {
+        TraceScope trace("name batch");
+        for (Animal* animal = first; animal != last; animal++)
+            animal->name = pools.take(animal->species);
+    });
+}
+
+// Function to pick a name as a pure function of the animal record.
+// A hash of species, age, color and origin (mixed with seed) indexes into the species' names
+// (in file order, or sorted for front-coded pools), so the same record always gets the same
+// name for the same seed and names file, with no shared state between threads or runs. Unlike NamePools, two animals with identical
+// records get the same name. Returns "Unnamed" if no matching name is found.
+// The view is valid until the next call on the same thread.
+string_view assignNameDeterministic(const Animal& animal, const NamesTable& namesTable, uint64_t seed) {
+    NamesTable::Names names = namesTable.find(animal.species);
+    if (names.empty())
+        return "Unnamed";
+    char age[16];
+    auto ageEnd = to_chars(age, age + sizeof(age), animal.age).ptr;
+    uint64_t h = hash64(animal.species, seed);
+    h = hash64(string_view(age, ageEnd - age), h);
+    h = hash64(animal.color, h);
+    h = hash64(animal.origin, h);
+    thread_local string decoded;
+    return names.get(h % names.size(), decoded);
+}
+
+// Function to name every animal deterministically (see assignNameDeterministic()) on all cores.
+void assignNamesDeterministic(ArrivingAnimals& animals, const NamesTable& namesTable, uint64_t seed) {
+    animals.parallelBatches(4096, [&](Animal* first, Animal* last) {
+        TraceScope trace("name batch");
+        for (Animal* animal = first; animal != last; animal++)
+            animal->name = assignNameDeterministic(*animal, namesTable, seed);
+    });
+}
+
+// Keeps the K heaviest (or oldest) animals of every species seen so far.
+// Each species has its own bounded min-heap: the root is the weakest animal kept,
+// so a new animal only enters the heap if it beats the root. Memory stays at
+// O(species x K) no matter how many animals are streamed through add().
+struct TopKTracker {
+    size_t k;
+    bool byWeight; // Rank by weight when true, by age otherwise.
+    map<string, vector<Animal>> heaps;
+
+    TopKTracker(size_t k, bool byWeight) : k(k), byWeight(byWeight) {}
+
+    int64_t key(const Animal& animal) const {
+        return byWeight ? animal.weight : animal.age;
+    }
+
+    // Heap comparator: orders animals so that the smallest key sits at the root.
+    bool ranksAbove(const Animal& a, const Animal& b) const {
+        return key(a) > key(b);
+    }
+
+    void add(const Animal& animal) {
+        if (k == 0)
+            return;
+        auto cmp = [this](const Animal& a, const Animal& b) { return ranksAbove(a, b); };
+        vector<Animal>& heap = heaps[animal.species.str()];
+        if (heap.size() < k) {
+            heap.push_back(animal);
+            push_heap(heap.begin(), heap.end(), cmp);
+        } else if (key(animal) > key(heap.front())) {
+            // Replace the weakest animal kept for this species.
+            pop_heap(heap.begin(), heap.end(), cmp);
+            heap.back() = animal;
+            push_heap(heap.begin(), heap.end(), cmp);
+        }
+    }
+
+    // Returns the kept animals per species, best first.
+    map<string, vector<Animal>> results() const {
+        map<string, vector<Animal>> sorted = heaps;
+        for (auto& pair : sorted) {
+            sort(pair.second.begin(), pair.second.end(),
+                 [this](const Animal& a, const Animal& b) { return ranksAbove(a, b); });
+        }
+        return sorted;
+    }
+};
+
+// Column-oriented copy of the numeric fields used by reports.
+// Species names are replaced by small integer IDs so aggregation kernels only touch flat arrays.
+struct AnimalColumns {
+    vector<string> speciesNames;  // speciesNames[id] is the species for that ID
+    vector<int32_t> speciesId;
+    vector<int32_t> age;
+    vector<int64_t> weight; // Hundredths of a pound, as in Animal.
+};
+
+// Function to convert a list of animals into columns, assigning species IDs in order of first appearance.
+AnimalColumns toColumns(const vector<Animal>& animals) {
+    AnimalColumns columns;
+    map<string, int32_t, less<>> ids;
+    columns.speciesId.reserve(animals.size());
+    columns.age.reserve(animals.size());
+    columns.weight.reserve(animals.size());
+    for (const auto& animal : animals) {
+        auto it = ids.find(animal.species.view());
+        if (it == ids.end()) {
+            it = ids.emplace(animal.species.str(), static_cast<int32_t>(columns.speciesNames.size())).first;
+            columns.speciesNames.push_back(animal.species.str());
+        }
+        columns.speciesId.push_back(it->second);
+        columns.age.push_back(animal.age);
+        columns.weight.push_back(animal.weight);
+    }
+    return columns;
+}
+
+// Count, sum, min and max of age and weight for one species.
+struct SpeciesAggregate {
+    uint64_t count = 0;
+    int64_t ageSum = 0;
+    int32_t ageMin = INT_MAX;
+    int32_t ageMax = INT_MIN;
+    int64_t weightSum = 0; // All weights in hundredths of a pound.
+    int64_t weightMin = INT64_MAX;
+    int64_t weightMax = INT64_MIN;
+
+    double ageMean() const { return count ? static_cast<double>(ageSum) / count : 0; }
+    double weightMean() const { return count ? weightInPounds(weightSum) / count : 0; }
+};
+
+// Reference implementation: one pass over the Animal structs with a map lookup per animal.
+map<string, SpeciesAggregate> aggregateNaive(const vector<Animal>& animals) {
+    map<string, SpeciesAggregate> result;
+    for (const auto& animal : animals) {
+        SpeciesAggregate& agg = result[animal.species.str()];
+        agg.count++;
+        agg.ageSum += animal.age;
+        agg.ageMin = min(agg.ageMin, animal.age);
+        agg.ageMax = max(agg.ageMax, animal.age);
+        agg.weightSum += animal.weight;
+        agg.weightMin = min(agg.weightMin, animal.weight);
+        agg.weightMax = max(agg.weightMax, animal.weight);
+    }
+    return result;
+}
+
+// Scalar kernel over the columns: one pass, accumulators indexed by species ID.
+vector<SpeciesAggregate> aggregateColumnsScalar(const AnimalColumns& columns) {
+    vector<SpeciesAggregate> result(columns.speciesNames.size());
+    size_t n = columns.speciesId.size();
+    for (size_t i = 0; i < n; i++) {
+        SpeciesAggregate& agg = result[columns.speciesId[i]];
+        agg.count++;
+        agg.ageSum += columns.age[i];
+        agg.ageMin = min(agg.ageMin, columns.age[i]);
+        agg.ageMax = max(agg.ageMax, columns.age[i]);
+        agg.weightSum += columns.weight[i];
+        agg.weightMin = min(agg.weightMin, columns.weight[i]);
+        agg.weightMax = max(agg.weightMax, columns.weight[i]);
+    }
+    return result;
+}
+
+#ifdef __AVX2__
+// AVX2 kernel for a single species: compares 8 species IDs at a time and folds the
+// matching lanes into vector accumulators, so there are no branches or scattered writes.
+SpeciesAggregate aggregateSpeciesAvx2(const AnimalColumns& columns, int32_t id) {
+    SpeciesAggregate agg;
+    size_t n = columns.speciesId.size();
+    const int32_t* ids = columns.speciesId.data();
+    const int32_t* ages = columns.age.data();
+    const int64_t* weights = columns.weight.data();
+    __m256i target = _mm256_set1_epi32(id);
+    __m256i countVec = _mm256_setzero_si256();
+    __m256i ageSumVec = _mm256_setzero_si256();
+    __m256i ageMinVec = _mm256_set1_epi32(INT_MAX);
+    __m256i ageMaxVec = _mm256_set1_epi32(INT_MIN);
+    __m256i weightSumVec = _mm256_setzero_si256();
+    __m256i weightMinVec = _mm256_set1_epi64x(INT64_MAX);
+    __m256i weightMaxVec = _mm256_set1_epi64x(INT64_MIN);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i mask = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i)), target);
+        __m256i age = _mm256_and_si256(mask, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ages + i)));
+        countVec = _mm256_sub_epi32(countVec, mask); // matching lanes are -1
+        // Widen ages to 64 bits before summing so long histories cannot overflow.
+        ageSumVec = _mm256_add_epi64(ageSumVec, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(age)));
+        ageSumVec = _mm256_add_epi64(ageSumVec, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(age, 1)));
+        ageMinVec = _mm256_min_epi32(ageMinVec, _mm256_blendv_epi8(_mm256_set1_epi32(INT_MAX), age, mask));
+        ageMaxVec = _mm256_max_epi32(ageMaxVec, _mm256_blendv_epi8(_mm256_set1_epi32(INT_MIN), age, mask));
+        for (int half = 0; half < 2; half++) {
+            __m128i mask32 = half ? _mm256_extracti128_si256(mask, 1) : _mm256_castsi256_si128(mask);
+            __m256i mask64 = _mm256_cvtepi32_epi64(mask32);
+            __m256i weight = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i + half * 4));
+            weightSumVec = _mm256_add_epi64(weightSumVec, _mm256_and_si256(mask64, weight));
+            // AVX2 has no 64-bit min/max, so compare and blend instead.
+            __m256i forMin = _mm256_blendv_epi8(_mm256_set1_epi64x(INT64_MAX), weight, mask64);
+            __m256i forMax = _mm256_blendv_epi8(_mm256_set1_epi64x(INT64_MIN), weight, mask64);
+            weightMinVec = _mm256_blendv_epi8(weightMinVec, forMin, _mm256_cmpgt_epi64(weightMinVec, forMin));
+            weightMaxVec = _mm256_blendv_epi8(weightMaxVec, forMax, _mm256_cmpgt_epi64(forMax, weightMaxVec));
+        }
+        // Flush the 32-bit lane counters before they could overflow.
+        if ((i & 0x3fffffff) == 0x3ffffff8) {
+            alignas(32) int32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), countVec);
+            for (int32_t lane : lanes)
+                agg.count += lane;
+            countVec = _mm256_setzero_si256();
+        }
+    }
+    alignas(32) int32_t int32Lanes[8];
+    alignas(32) int64_t int64Lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int32Lanes), countVec);
+    for (int32_t lane : int32Lanes)
+        agg.count += lane;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int64Lanes), ageSumVec);
+    for (int64_t lane : int64Lanes)
+        agg.ageSum += lane;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int32Lanes), ageMinVec);
+    for (int32_t lane : int32Lanes)
+        agg.ageMin = min(agg.ageMin, lane);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int32Lanes), ageMaxVec);
+    for (int32_t lane : int32Lanes)
+        agg.ageMax = max(agg.ageMax, lane);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int64Lanes), weightSumVec);
+    for (int64_t lane : int64Lanes)
+        agg.weightSum += lane;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int64Lanes), weightMinVec);
+    for (int64_t lane : int64Lanes)
+        agg.weightMin = min(agg.weightMin, lane);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(int64Lanes), weightMaxVec);
+    for (int64_t lane : int64Lanes)
+        agg.weightMax = max(agg.weightMax, lane);
+    // Scalar tail for the last few rows.
+    for (; i < n; i++) {
+        if (ids[i] != id)
+            continue;
+        agg.count++;
+        agg.ageSum += ages[i];
+        agg.ageMin = min(agg.ageMin, ages[i]);
+        agg.ageMax = max(agg.ageMax, ages[i]);
+        agg.weightSum += weights[i];
+        agg.weightMin = min(agg.weightMin, weights[i]);
+        agg.weightMax = max(agg.weightMax, weights[i]);
+    }
+    return agg;
+}
+#endif
+
+// Function to compute per-species aggregates over the columns.
+// With AVX2 each species is a separate vectorized pass, which wins while the number of
+// species is small (the zoo has a handful); past that the single scalar pass is cheaper.
+vector<SpeciesAggregate> aggregateColumns(const AnimalColumns& columns) {
+#ifdef __AVX2__
+    const size_t maxSimdSpecies = 16;
+    if (columns.speciesNames.size() <= maxSimdSpecies) {
+        vector<SpeciesAggregate> result;
+        for (size_t id = 0; id < columns.speciesNames.size(); id++)
+            result.push_back(aggregateSpeciesAvx2(columns, static_cast<int32_t>(id)));
+        return result;
+    }
+#endif
+    return aggregateColumnsScalar(columns);
+}
+
+// Subcommand: "topk <K> <weight|age> [populationFile]".
+// Streams the population report once and prints the K heaviest or oldest animals per species.
+int runTopK(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " topk <K> <weight|age> [populationFile]" << endl;
+        return 1;
+    }
+    // K must be a positive decimal number; from_chars rejects signs, so "-1" cannot wrap.
+    string_view kText = argv[2];
+    size_t k = 0;
+    auto parsed = from_chars(kText.data(), kText.data() + kText.size(), k);
+    if (parsed.ec != errc() || parsed.ptr != kText.data() + kText.size() || k == 0) {
+        cerr << "Invalid K: " << kText << " (expected a positive number)" << endl;
+        return 1;
+    }
+    string rankBy = argv[3];
+    if (rankBy != "weight" && rankBy != "age") {
+        cerr << "Unknown ranking field: " << rankBy << endl;
+        return 1;
+    }
+    string filename = argc > 4 ? argv[4] : "newAnimals.txt";
+    TopKTracker tracker(k, rankBy == "weight");
+    if (!forEachPopulationRecord(filename, [&tracker](const Animal& animal) { tracker.add(animal); }))
+        return 1;
+    for (const auto& pair : tracker.results()) {
+        cout << pair.first << ":\n";
+        for (const auto& animal : pair.second) {
+            cout << "  " << animal.name << ", age " << animal.age << ", " << formatWeight(animal.weight) << " pounds\n";
+        }
+    }
+    return 0;
+}
+
+// Subcommand: "stats [populationFile]".
+// Answers distinct-count and weight-percentile questions from the persisted sketches only.
+int runStats(int argc, char* argv[]) {
+    string filename = argc > 2 ? argv[2] : "newAnimals.txt";
+    auto start = chrono::steady_clock::now();
+    PopulationSketches sketches;
+    if (!loadSketches(sketchFilename(filename), sketches)) {
+        cerr << "No sketches found for " << filename << endl;
+        return 1;
+    }
+    double distinctNames = sketches.names.estimate();
+    double distinctOrigins = sketches.origins.estimate();
+    double p50 = sketches.weights.quantile(0.5);
+    double p90 = sketches.weights.quantile(0.9);
+    double p99 = sketches.weights.quantile(0.99);
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+    cout << "Records: " << sketches.records << "\n"
+         << "Distinct names (approx.): " << llround(distinctNames) << "\n"
+         << "Distinct origins (approx.): " << llround(distinctOrigins) << "\n"
+         << "Weight p50/p90/p99: " << p50 << " / " << p90 << " / " << p99 << "\n"
+         << "Answered in " << elapsed.count() << " us\n";
+    return 0;
+}
+
+// Subcommand: "summary [populationFile]".
+// Prints count, mean, min and max of age and weight for every species in the report.
+int runSummary(int argc, char* argv[]) {
+    string filename = argc > 2 ? argv[2] : "newAnimals.txt";
+    vector<Animal> animals;
+    if (!forEachPopulationRecord(filename, [&animals](const Animal& animal) { animals.push_back(animal); }))
+        return 1;
+    AnimalColumns columns = toColumns(animals);
+    vector<SpeciesAggregate> aggregates = aggregateColumns(columns);
+    for (size_t id = 0; id < aggregates.size(); id++) {
+        const SpeciesAggregate& agg = aggregates[id];
+        cout << columns.speciesNames[id] << ": " << agg.count << " animals\n"
+             << "  age    mean " << agg.ageMean() << ", min " << agg.ageMin << ", max " << agg.ageMax << "\n"
+             << "  weight mean " << agg.weightMean() << ", min " << formatWeight(agg.weightMin) << ", max " << formatWeight(agg.weightMax) << "\n";
+    }
+    return 0;
+}
+
+// Times a piece of work repeated several times and returns nanoseconds per animal.
+// With --perf the runs are also measured with hardware counters under the given label.
+double nanosPerAnimal(const string& label, size_t animalCount, int repeats, const function<void()>& work) {
+    auto start = chrono::steady_clock::now();
+    measureStage(label, [&]() {
+        for (int r = 0; r < repeats; r++)
+            work();
+        return animalCount * repeats;
+    });
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    return static_cast<double>(elapsed.count()) / repeats / max<size_t>(animalCount, 1);
+}
+
+// Subcommand: "bench [arrivingFile] [--perf] [--assert-allocs <stage>=<max per record>]...".
+// Micro-benchmarks the hot paths over the given arrivals file.
+// In a ZOO_COUNT_ALLOCATIONS build it also reports heap allocations per record for the
+// intake, name and write stages, and fails if a stage exceeds a limit given with --assert-allocs
+// (stages: intake, name, write).
+int runBench(int argc, char* argv[]) {
+    string filename = "arrivingAnimals.txt";
+    map<string, double> allocationLimits;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--perf") {
+            perfStages().enabled = true;
+        } else if (arg == "--assert-allocs" && i + 1 < argc) {
+            string limit = argv[++i];
+            size_t equals = limit.find('=');
+            if (equals == string::npos) {
+                cerr << "Expected <stage>=<max per record>: " << limit << endl;
+                return 1;
+            }
+            allocationLimits[limit.substr(0, equals)] = atof(limit.c_str() + equals + 1);
+        } else {
+            filename = arg;
+        }
+    }
+    if (!allocationLimits.empty() && !countingAllocations()) {
+        cerr << "--assert-allocs needs a build with -DZOO_COUNT_ALLOCATIONS" << endl;
+        return 1;
+    }
+    ArrivingAnimals animals;
+    double intake = nanosPerAnimal("intake", 1, 1, [&]() { animals = loadArrivingAnimals(filename, "/dev/null"); });
+    if (animals.empty()) {
+        cerr << "No animals to benchmark in " << filename << endl;
+        return 1;
+    }
+    const int repeats = 20;
+    volatile double sink = 0; // Keeps the compiler from discarding benchmark results.
+    cout << "Benchmarking " << animals.size() << " animals\n";
+    cout << "intake loadArrivingAnimals:             " << intake / animals.size() << " ns/animal ("
+         << fileSizeOrZero(filename) / intake * 1000 << " MB/s)\n";
+
+    // Parsing alone, from a file already read into memory, so mapping and page-fault costs
+    // are left out.
+    {
+        ifstream input(filename, ios::binary);
+        string text((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+        bool json = filename.size() >= 6 && filename.compare(filename.size() - 6, 6, ".jsonl") == 0;
+        double best = 0;
+        for (int r = 0; r < 5; r++) {
+            ArrivalsChunk chunk;
+            auto start = chrono::steady_clock::now();
+            parseArrivalsChunk(text, json, chunk);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            best = max(best, text.size() / seconds / 1e6);
+        }
+        cout << "intake parse from memory (best of 5):   " << best << " MB/s\n";
+    }
+
+    // Serial against chunked parallel intake on the thread pool.
+    const NumaTopology& numa = threadPoolConfig().numa;
+    cout << "intake pool: " << parallelism() << " threads on " << max<size_t>(1, numa.nodeCpus.size())
+         << (numa.simulated ? " simulated" : "") << " NUMA node(s)\n";
+    IntakeOptions serialIntake;
+    serialIntake.parallel = false;
+    ArrivingAnimals loaded;
+    double serialNanos = nanosPerAnimal("intake serial", animals.size(), 3, [&]() {
+        loaded = loadArrivingAnimals(filename, "/dev/null", serialIntake);
+    });
+    double parallelNanos = nanosPerAnimal("intake parallel", animals.size(), 3, [&]() {
+        loaded = loadArrivingAnimals(filename, "/dev/null");
+    });
+    cout << "intake serial chunk:                    " << serialNanos << " ns/animal\n";
+    cout << "intake parallel chunks:                 " << parallelNanos << " ns/animal\n";
+
+    // Intake with different mapping hints. The file is dropped from the page cache first
+    // (when the kernel allows it) so readahead and faulting behaviour actually show up.
+    struct IntakeVariant {
+        const char* label;
+        IntakeOptions options;
+    };
+    IntakeOptions noHints;
+    noHints.sequential = false;
+    IntakeOptions populate;
+    populate.populate = true;
+    IntakeOptions willNeed;
+    willNeed.willNeed = true;
+    IntakeOptions hugePages;
+    hugePages.hugePages = true;
+    for (const IntakeVariant& variant : {IntakeVariant{"no hints", noHints}, IntakeVariant{"sequential", IntakeOptions()},
+                                         IntakeVariant{"sequential + populate", populate},
+                                         IntakeVariant{"sequential + willneed", willNeed},
+                                         IntakeVariant{"sequential + hugepage", hugePages}}) {
+#if defined(__unix__) && defined(POSIX_FADV_DONTNEED)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+#endif
+        ArrivingAnimals loaded;
+        double nanos = nanosPerAnimal(string("intake ") + variant.label, 1, 1, [&]() {
+            loaded = loadArrivingAnimals(filename, "/dev/null", variant.options);
+        });
+        cout << "intake " << variant.label << ":" << string(32 - strlen(variant.label), ' ')
+             << nanos / max<size_t>(loaded.size(), 1) << " ns/animal\n";
+    }
+
+    // The aggregation kernels work on one contiguous array, as they do for report files.
+    vector<Animal> contiguous(animals.begin(), animals.end());
+    double naive = nanosPerAnimal("aggregate naive", animals.size(), repeats, [&]() {
+        sink = sink + aggregateNaive(contiguous).begin()->second.weightSum;
+    });
+    AnimalColumns columns = toColumns(contiguous);
+    double scalar = nanosPerAnimal("aggregate scalar", animals.size(), repeats, [&]() {
+        sink = sink + aggregateColumnsScalar(columns)[0].weightSum;
+    });
+    double kernel = nanosPerAnimal("aggregate kernel", animals.size(), repeats, [&]() {
+        sink = sink + aggregateColumns(columns)[0].weightSum;
+    });
+    cout << "aggregate naive (vector<Animal> + map): " << naive << " ns/animal\n"
+         << "aggregate columns scalar:               " << scalar << " ns/animal\n"
+#ifdef __AVX2__
+         << "aggregate columns AVX2:                 " << kernel << " ns/animal\n";
+#else
+         << "aggregate columns (no AVX2 build):      " << kernel << " ns/animal\n";
+#endif
+
+    // Weight formatting: fixed-point integer formatting against ostream's double formatting.
+    double fixedFormat = nanosPerAnimal("format fixed-point", animals.size(), repeats, [&]() {
+        string out;
+        for (const auto& animal : animals)
+            appendWeight(out, animal.weight);
+        sink = sink + out.size();
+    });
+    double streamFormat = nanosPerAnimal("format ostream", animals.size(), repeats, [&]() {
+        ostringstream out;
+        for (const auto& animal : animals)
+            out << weightInPounds(animal.weight);
+        sink = sink + out.str().size();
+    });
+    cout << "weight format fixed-point:              " << fixedFormat << " ns/animal\n"
+         << "weight format ostream double:           " << streamFormat << " ns/animal\n";
+
+    // Report serializers into the bulk output buffer.
+    size_t csvBytes = 0, jsonBytes = 0;
+    double csv = nanosPerAnimal("write CSV", animals.size(), repeats, [&]() {
+        string out;
+        out.reserve(animals.size() * 128);
+        for (const auto& animal : animals)
+            appendCsvRecord(out, animal);
+        csvBytes = out.size();
+        trackMemory(OutputMemory, static_cast<int64_t>(out.capacity()));
+        trackMemory(OutputMemory, -static_cast<int64_t>(out.capacity()));
+    });
+    double json = nanosPerAnimal("write JSON Lines", animals.size(), repeats, [&]() {
+        string out;
+        out.reserve(animals.size() * 192);
+        for (const auto& animal : animals)
+            appendJsonRecord(out, animal);
+        jsonBytes = out.size();
+        trackMemory(OutputMemory, static_cast<int64_t>(out.capacity()));
+        trackMemory(OutputMemory, -static_cast<int64_t>(out.capacity()));
+    });
+    cout << "write CSV records:                      " << csv << " ns/animal ("
+         << csvBytes / (csv * animals.size()) * 1000 << " MB/s)\n"
+         << "write JSON Lines records:               " << json << " ns/animal ("
+         << jsonBytes / (json * animals.size()) * 1000 << " MB/s, " << json / csv << "x CSV)\n";
+
+    // Serial rand() naming against lock-free parallel naming from shuffled pools.
+    NamesTable benchNames = loadAnimalNames("animalNames.txt");
+    trackMemory(NamesMemory, heapBytes(benchNames));
+    double serialNames = nanosPerAnimal("names serial", animals.size(), repeats, [&]() {
+        for (auto& animal : animals)
+            animal.name = assignName(animal.species, benchNames);
+    });
+    double parallelNames = nanosPerAnimal("names parallel", animals.size(), repeats, [&]() {
+        NamePools pools(benchNames, 1);
+        assignNamesParallel(animals, pools);
+    });
+    double hashedNames = nanosPerAnimal("names deterministic", animals.size(), repeats, [&]() {
+        assignNamesDeterministic(animals, benchNames, 1);
+    });
+    cout << "names serial assignName():              " << serialNames << " ns/animal\n"
+         << "names deterministic (record hash):      " << hashedNames << " ns/animal\n"
+         << "names parallel pools (" << parallelism() << " threads):       "
+         << parallelNames << " ns/animal\n";
+
+    // Species lookups in the flat names table against node-based standard containers keyed
+    // by std::string, which need a temporary string per lookup.
+    map<string, vector<string>> namesByMap;
+    unordered_map<string, vector<string>> namesByHash;
+    for (size_t i = 0; i < benchNames.size(); i++) {
+        NamesTable::Names names = benchNames.names(i);
+        vector<string>& list = namesByMap[string(benchNames.species(i))];
+        for (size_t j = 0; j < names.size(); j++)
+            list.emplace_back(names[j]);
+        namesByHash[string(benchNames.species(i))] = list;
+    }
+    size_t found = 0;
+    double mapLookup = nanosPerAnimal("names lookup std::map", animals.size(), repeats, [&]() {
+        for (const auto& animal : animals) {
+            auto it = namesByMap.find(animal.species.str());
+            found += it != namesByMap.end() ? it->second.size() : 0;
+        }
+    });
+    double hashLookup = nanosPerAnimal("names lookup unordered_map", animals.size(), repeats, [&]() {
+        for (const auto& animal : animals) {
+            auto it = namesByHash.find(animal.species.str());
+            found += it != namesByHash.end() ? it->second.size() : 0;
+        }
+    });
+    double flatLookup = nanosPerAnimal("names lookup flat", animals.size(), repeats, [&]() {
+        for (const auto& animal : animals)
+            found += benchNames.find(animal.species).size();
+    });
+    sink = sink + found;
+    cout << "names lookup std::map:                  " << mapLookup << " ns/animal\n"
+         << "names lookup std::unordered_map:        " << hashLookup << " ns/animal\n"
+         << "names lookup flat table:                " << flatLookup << " ns/animal ("
+         << formatBytes(heapBytes(benchNames)) << ")\n";
+
+    // Memory and random access for one very large pool: vector<string>, plain spans and
+    // front-coded blocks. Names are made of syllables so they share prefixes like real ones.
+    {
+        static const char* syllables[] = {"ka", "lo", "mi", "ra", "zu", "be", "ni", "to", "sha", "vel",
+                                          "dor", "an", "is", "mu", "re", "el", "qui", "nor", "fa", "ti"};
+        mt19937_64 random(1);
+        vector<string> largePool(200000);
+        for (auto& name : largePool) {
+            size_t parts = 2 + random() % 4;
+            for (size_t k = 0; k < parts; k++)
+                name += syllables[random() % 20];
+            name[0] = static_cast<char>(toupper(name[0]));
+        }
+        map<string, vector<string>> largeNames{{"Synthetic", largePool}};
+        NamesTable plain(largeNames, SIZE_MAX);
+        NamesTable frontCoded(largeNames);
+        int64_t largeTableBytes = static_cast<int64_t>(heapBytes(plain) + heapBytes(frontCoded));
+        trackMemory(NamesMemory, largeTableBytes);
+        size_t vectorBytes = largePool.capacity() * sizeof(string);
+        for (const auto& name : largePool)
+            vectorBytes += heapBytes(name);
+        const size_t accesses = 1000000;
+        vector<uint32_t> indexes(accesses);
+        for (auto& index : indexes)
+            index = static_cast<uint32_t>(random() % largePool.size());
+        size_t totalLength = 0;
+        double plainAccess = nanosPerAnimal("names large pool plain", accesses, 1, [&]() {
+            NamesTable::Names names = plain.names(0);
+            for (uint32_t index : indexes)
+                totalLength += names[index].size();
+        });
+        double codedAccess = nanosPerAnimal("names large pool front-coded", accesses, 1, [&]() {
+            NamesTable::Names names = frontCoded.names(0);
+            for (uint32_t index : indexes)
+                totalLength += names[index].size();
+        });
+        sink = sink + totalLength;
+        cout << "large pool (" << largePool.size() << " names) vector<string>: " << formatBytes(vectorBytes) << "\n"
+             << "large pool plain spans:                 " << formatBytes(heapBytes(plain)) << ", "
+             << plainAccess << " ns/access\n"
+             << "large pool front-coded:                 " << formatBytes(heapBytes(frontCoded)) << ", "
+             << codedAccess << " ns/access\n";
+        trackMemory(NamesMemory, -largeTableBytes);
+    }
+
+    // Report writes with and without O_DIRECT while another thread keeps re-reading the
+    // arrivals file, to see how much each write mode disturbs a concurrent reader.
+    for (bool direct : {false, true}) {
+        string scratch = temporarySpillPrefix(direct ? "bench-direct" : "bench-buffered");
+        atomic<bool> writing(true);
+        atomic<uint64_t> bytesRead(0);
+        auto readStart = chrono::steady_clock::now();
+        thread reader([&]() {
+            vector<char> chunk(1 << 20);
+            while (writing) {
+                ifstream in(filename, ios::binary);
+                while (writing && in.read(chunk.data(), chunk.size()))
+                    bytesRead += chunk.size();
+                bytesRead += in.gcount();
+            }
+        });
+        double nanos = nanosPerAnimal(direct ? "write O_DIRECT" : "write buffered", animals.size(), 5, [&]() {
+            updateZooPopulation(scratch, animals, CsvOutput, direct);
+        });
+        writing = false;
+        reader.join();
+        double readSeconds = chrono::duration<double>(chrono::steady_clock::now() - readStart).count();
+        cout << (direct ? "write O_DIRECT:                         " : "write buffered:                         ")
+             << nanos << " ns/animal, concurrent reader " << bytesRead / readSeconds / 1e6 << " MB/s\n";
+        remove(scratch.c_str());
+        remove(sketchFilename(scratch).c_str());
+    }
+
+    // Heap allocations per record on the intake, name and write paths.
+    if (countingAllocations()) {
+        map<string, double> perRecord;
+        perRecord["intake"] = countAllocations([&]() { loadArrivingAnimals(filename, "/dev/null"); });
+        NamesTable namesTable = loadAnimalNames("animalNames.txt");
+        perRecord["name"] = countAllocations([&]() {
+            for (auto& animal : animals)
+                animal.name = assignName(animal.species, namesTable);
+        });
+        string scratch = temporarySpillPrefix("bench-write");
+        perRecord["write"] = countAllocations([&]() { updateZooPopulation(scratch, animals); });
+        remove(scratch.c_str());
+        remove(sketchFilename(scratch).c_str());
+        bool withinLimits = true;
+        for (auto& stage : perRecord) {
+            stage.second /= animals.size();
+            cout << "allocations per record, " << stage.first << ": " << stage.second;
+            auto limit = allocationLimits.find(stage.first);
+            if (limit != allocationLimits.end()) {
+                bool ok = stage.second <= limit->second;
+                withinLimits = withinLimits && ok;
+                cout << (ok ? " (within " : " (EXCEEDS ") << limit->second << ")";
+            }
+            cout << "\n";
+        }
+        for (const auto& limit : allocationLimits) {
+            if (!perRecord.count(limit.first)) {
+                cerr << "Unknown stage for --assert-allocs: " << limit.first << endl;
+                return 1;
+            }
+        }
+        if (!withinLimits)
+            return 1;
+    }
+
+    // Account for the loaded animals.
+    trackMemory(IntakeMemory, heapBytes(animals));
+    printMemoryReport(cout);
+    printPerfReport(cout);
+    return 0;
+}
+
+// Subcommand: "lookup <id> [populationFile]".
+// Loads the report into an ID-indexed table and prints the animal with that ID.
+int runLookup(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " lookup <id> [populationFile]" << endl;
+        return 1;
+    }
+    uint64_t id = strtoull(argv[2], nullptr, 10);
+    string filename = argc > 3 ? argv[3] : "newAnimals.txt";
+    PopulationTable table;
+    if (!forEachPopulationRecord(filename, [&table](const Animal& animal) { table.add(animal); }))
+        return 1;
+    const Animal* animal = table.find(id);
+    if (!animal) {
+        cerr << "No animal with ID " << id << endl;
+        return 1;
+    }
+    cout << animal->id << ": " << animal->name << ", " << animal->species << ", age " << animal->age << ", "
+         << animal->birthSeason << ", " << animal->color << ", " << formatWeight(animal->weight) << " pounds, "
+         << animal->origin << "\n";
+    return 0;
+}
+
+// Subcommand: "search <text> [populationFile] [--prefix] [--limit N]".
+// Prints the animals whose name contains the text (or starts with it, with --prefix),
+// ignoring case. At most --limit matches are printed (default 20); the count is always shown.
+int runSearch(int argc, char* argv[]) {
+    string query;
+    string filename = "newAnimals.txt";
+    bool prefixOnly = false;
+    size_t limit = 20;
+    int positional = 0;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--prefix") {
+            prefixOnly = true;
+        } else if (arg == "--limit" && i + 1 < argc) {
+            limit = strtoull(argv[++i], nullptr, 10);
+        } else if (positional++ == 0) {
+            query = arg;
+        } else {
+            filename = arg;
+        }
+    }
+    if (positional == 0) {
+        cerr << "Usage: " << argv[0] << " search <text> [populationFile] [--prefix] [--limit N]" << endl;
+        return 1;
+    }
+    vector<Animal> rows;
+    if (!forEachPopulationRecord(filename, [&rows](const Animal& animal) { rows.push_back(animal); }))
+        return 1;
+    auto start = chrono::steady_clock::now();
+    NameSearchIndex index;
+    index.build(rows);
+    auto built = chrono::steady_clock::now();
+    vector<size_t> matches = index.search(query, prefixOnly);
+    auto searched = chrono::steady_clock::now();
+    for (size_t i = 0; i < matches.size() && i < limit; i++) {
+        const Animal& animal = rows[matches[i]];
+        cout << animal.id << ": " << animal.name << ", " << animal.species << ", age " << animal.age << "\n";
+    }
+    if (matches.size() > limit)
+        cout << "... " << matches.size() - limit << " more\n";
+    cout << matches.size() << " of " << rows.size() << " animals match \"" << query << "\" (index built in "
+         << chrono::duration<double, milli>(built - start).count() << " ms, " << formatBytes(index.bytes())
+         << "; search took " << chrono::duration<double, milli>(searched - built).count() << " ms)" << endl;
+    return 0;
+}
+
+// Subcommand: "diff <oldFile> <newFile> [memoryBudgetMB]".
+// Prints added (+), removed (-) and changed (~) animals between two population snapshots.
+int runDiff(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " diff <oldFile> <newFile> [memoryBudgetMB]" << endl;
+        return 1;
+    }
+    uintmax_t budget = (argc > 4 ? strtoull(argv[4], nullptr, 10) : 256) * 1024 * 1024;
+    for (int i = 2; i <= 3; i++) {
+        if (!ifstream(argv[i])) {
+            cerr << "Error opening file: " << argv[i] << endl;
+            return 1;
+        }
+    }
+    size_t added = 0, removed = 0, changed = 0;
+    bool ok = diffPopulations(argv[2], argv[3], budget, [&](const PopulationDiff& diff) {
+        for (const auto& record : diff.added)
+            cout << "+ " << record << "\n";
+        for (const auto& record : diff.removed)
+            cout << "- " << record << "\n";
+        for (const auto& change : diff.changed)
+            cout << "~ " << change.first << "\n  -> " << change.second << "\n";
+        added += diff.added.size();
+        removed += diff.removed.size();
+        changed += diff.changed.size();
+    });
+    if (!ok) {
+        cerr << "diff failed" << endl;
+        return 1;
+    }
+    cout << added << " added, " << removed << " removed, " << changed << " changed\n";
+    return 0;
+}
+
+// Subcommand: "join <vetFile> [populationFile] [memoryBudgetMB]".
+// Prints every population record that has matching veterinary records, followed by the vet fields.
+int runJoin(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " join <vetFile> [populationFile] [memoryBudgetMB]" << endl;
+        return 1;
+    }
+    string vetFile = argv[2];
+    string populationFile = argc > 3 ? argv[3] : "newAnimals.txt";
+    uintmax_t budget = (argc > 4 ? strtoull(argv[4], nullptr, 10) : 256) * 1024 * 1024;
+    for (const string& filename : {vetFile, populationFile}) {
+        if (!ifstream(filename)) {
+            cerr << "Error opening file: " << filename << endl;
+            return 1;
+        }
+    }
+    size_t matches = 0;
+    bool ok = hashJoinVetRecords(populationFile, vetFile, budget, [&matches](const string& animal, const string& vet) {
+        cout << animal << " | " << vet << "\n";
+        matches++;
+    });
+    if (!ok) {
+        cerr << "join failed" << endl;
+        return 1;
+    }
+    cout << matches << " matches\n";
+    return 0;
+}
+
+// Subcommand: "selftest".
+// Runs checks on the parts of the program that are easy to get subtly wrong.
+// Prints each failed check and returns 1 if any failed.
+int runSelfTest(int, char*[]) {
+    int failures = 0;
+    auto check = [&failures](bool ok, const string& what) {
+        if (!ok) {
+            cerr << "FAIL: " << what << endl;
+            failures++;
+        }
+    };
+
+    // Chase-Lev deque: the owner pushes and takes while thieves steal. Taking after every
+    // other push keeps the deque near empty, so take and steal often race for the last task.
+    {
+        const size_t taskCount = 200000;
+        vector<atomic<int>> runs(taskCount);
+        ChaseLevDeque deque;
+        atomic<bool> done{false};
+        vector<thread> thieves;
+        for (int t = 0; t < 2; t++) {
+            thieves.emplace_back([&deque, &done]() {
+                while (!done.load(memory_order_acquire)) {
+                    if (Task* task = deque.steal()) {
+                        (*task)();
+                        delete task;
+                    }
+                }
+            });
+        }
+        auto runTaken = [&deque]() {
+            Task* task = deque.take();
+            if (task) {
+                (*task)();
+                delete task;
+            }
+            return task != nullptr;
+        };
+        for (size_t i = 0; i < taskCount; i++) {
+            deque.push(new Task([&runs, i]() { runs[i]++; }));
+            if (i % 2 == 0)
+                runTaken();
+        }
+        while (runTaken()) {
+        }
+        done = true;
+        for (auto& thief : thieves)
+            thief.join();
+        size_t wrong = 0;
+        for (auto& count : runs)
+            wrong += count.load() != 1;
+        check(wrong == 0, "deque: " + to_string(wrong) + " tasks not run exactly once");
+    }
+
+    // Work-stealing pool: tasks submitted from workers land on their own deques and are
+    // stolen by the others; the caller helps until every task has run.
+    {
+        ThreadPoolConfig config;
+        config.threads = 4;
+        WorkStealingPool pool(config);
+        const size_t outer = 64, inner = 256;
+        atomic<size_t> finished{0};
+        for (size_t i = 0; i < outer; i++) {
+            pool.submit([&pool, &finished]() {
+                for (size_t j = 0; j < inner; j++)
+                    pool.submit([&finished]() { finished++; });
+                finished++;
+            });
+        }
+        uint64_t seed = 1;
+        while (finished.load() < outer * (inner + 1)) {
+            if (!pool.runOne(seed))
+                this_thread::yield();
+        }
+        check(finished.load() == outer * (inner + 1), "pool: wrong number of tasks run");
+    }
+
+    // Front-coded names: every index decodes to the right name, including the first and last
+    // name of each block, names that are prefixes of each other and a pool ending on a block.
+    {
+        map<string, vector<string>> namesBySpecies;
+        vector<string>& lions = namesBySpecies["Lion"];
+        for (size_t i = 0; i < 16 * 20 + 3; i++)
+            lions.push_back("Leo" + string(i % 7, 'o') + to_string(i));
+        lions.push_back("L");
+        lions.push_back("Le");
+        vector<string>& bears = namesBySpecies["Bear"];
+        for (size_t i = 0; i < 256; i++)
+            bears.push_back("Bruin" + to_string(i));
+        namesBySpecies["Hyena"] = {"Shenzi", "Banzai", "Ed"};
+        NamesTable table(namesBySpecies);
+        for (const auto& pair : namesBySpecies) {
+            NamesTable::Names names = table.find(pair.first);
+            vector<string> expected = pair.second;
+            if (names.sorted())
+                sort(expected.begin(), expected.end());
+            check(names.size() == expected.size(), "names: wrong count for " + pair.first);
+            for (size_t i = 0; i < expected.size() && i < names.size(); i++)
+                check(names[i] == expected[i], "names: " + pair.first + "[" + to_string(i) + "] decoded as " + names[i]);
+        }
+        check(table.find("lion").size() == lions.size(), "names: case-insensitive species lookup");
+    }
+
+    // Weights: text is rounded half-up to hundredths, and formatting then parsing gives the same value.
+    {
+        const pair<const char*, int64_t> parsed[] = {
+            {"70", 7000}, {"270.5", 27050}, {"12.25", 1225}, {"1.995", 200}, {"1.994", 199},
+            {"81 pounds", 8100}, {"-3.1", -310}, {" .5", 50}};
+        for (const auto& expected : parsed) {
+            int64_t hundredths = 0;
+            check(parseWeight(expected.first, hundredths) && hundredths == expected.second,
+                  string("weight: \"") + expected.first + "\" parsed as " + to_string(hundredths));
+        }
+        check(formatWeight(200) == "2", "weight: 2.00 formatted as " + formatWeight(200));
+        int64_t ignored;
+        check(!parseWeight("pounds", ignored), "weight: accepted text without digits");
+        check(!parseWeight("99999999999999999999", ignored), "weight: accepted a value that overflows");
+        const int64_t roundTrip[] = {0, 1, 10, 99, 100, 105, 27050, -1, -27050, (INT64_MAX - 100) / 100 * 100 + 99};
+        for (int64_t value : roundTrip) {
+            int64_t back = 0;
+            string text = formatWeight(value);
+            check(parseWeight(text, back) && back == value, "weight: " + to_string(value) + " read back as " + to_string(back));
+        }
+    }
+
+    // Sketches: merging two halves gives about the same answers as one sketch of everything.
+    {
+        PopulationSketches low, high;
+        for (int i = 0; i < 100000; i++) {
+            Animal animal;
+            animal.name = "n" + to_string(i);
+            animal.origin = "o" + to_string(i % 1000);
+            animal.weight = int64_t(i + 1) * 100;
+            (i < 50000 ? low : high).add(animal);
+        }
+        low.merge(high);
+        check(low.records == 100000, "sketches: merged record count");
+        double names = low.names.estimate(), origins = low.origins.estimate();
+        check(fabs(names - 100000) < 3000, "hyperloglog: merged estimate " + to_string(names) + " for 100000 names");
+        check(fabs(origins - 1000) < 30, "hyperloglog: merged estimate " + to_string(origins) + " for 1000 origins");
+        double median = low.weights.quantile(0.5), p99 = low.weights.quantile(0.99);
+        check(fabs(median - 50000) < 500, "t-digest: merged median " + to_string(median));
+        check(fabs(p99 - 99000) < 500, "t-digest: merged 99th percentile " + to_string(p99));
+    }
+
+    // JSON strings: escapes and surrogate pairs are decoded to UTF-8; values the reports
+    // cannot hold are rejected.
+    {
+        Animal animal;
+        bool ok = parseJsonAnimal(R"({"name":"Café🦁","species":"Lion","age":4,"weight":"81.5"})", animal);
+        check(ok && animal.name == "Caf\xc3\xa9\xf0\x9f\xa6\x81", "json: surrogate pair decoded as " + animal.name.str());
+        check(ok && animal.weight == 8150 && animal.age == 4, "json: numbers");
+        ok = parseJsonAnimal(R"({"name":"Tab\/\"x\"","species":"Lion","age":4,"weight":81})", animal);
+        check(ok && animal.name == "Tab/\"x\"", "json: escapes decoded as " + animal.name.str());
+        check(!parseJsonAnimal(R"({"name":"\ud83eA","species":"Lion","age":4,"weight":81})", animal),
+              "json: high surrogate followed by a non-surrogate");
+        check(!parseJsonAnimal(R"({"name":"\udd81","species":"Lion","age":4,"weight":81})", animal),
+              "json: lone low surrogate");
+        check(!parseJsonAnimal(R"({"name":"a,b","species":"Lion","age":4,"weight":81})", animal), "json: comma in a text field");
+        check(!parseJsonAnimal(R"({"name":"a\nb","species":"Lion","age":4,"weight":81})", animal), "json: escaped newline");
+        check(!parseJsonAnimal(R"({"name":"unterminated,"species":"Lion","age":4})", animal), "json: unterminated string");
+
+        // Numbers must be read whole, and nothing may follow the object.
+        check(!parseJsonAnimal(R"({"species":"Lion","age":4,"weight":1.5e2})", animal), "json: exponent weight");
+        check(!parseJsonAnimal(R"({"species":"Lion","age":4.9,"weight":81})", animal), "json: fractional age");
+        check(!parseJsonAnimal(R"({"id":7x,"species":"Lion","age":4,"weight":81})", animal), "json: malformed id");
+        check(!parseJsonAnimal(R"({"species":"Lion","age":4,"weight":81} trailing garbage)", animal),
+              "json: text after the object");
+        ok = parseJsonAnimal(R"({"id":7,"species":"Lion","age":4,"weight":-0.25}  )", animal);
+        check(ok && animal.id == 7 && animal.weight == -25, "json: plain numbers and trailing spaces");
+    }
+
+    if (failures > 0) {
+        cerr << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "All checks passed\n";
+    return 0;
+}
+
+#ifdef ZOO_ASYNC_INTAKE
+// Coroutine intake pipeline: each arrivals file is a coroutine whose stages (read, parse,
+// name, write) are co_awaited. Blocking work runs on the thread pool; when it finishes, the
+// pool thread queues the coroutine and signals an eventfd that the event loop waits on with
+// epoll, so one loop thread keeps several files in flight. (Regular files cannot be polled,
+// which is why reads are preads on the pool rather than epoll readiness.)
+
+class EventLoop;
+
+// A lazily started coroutine that produces a T. Awaiting it starts it and resumes the
+// awaiting coroutine when it finishes.
+template <class T>
+class AsyncTask {
+public:
+    struct promise_type {
+        optional<T> value;
+        exception_ptr error;
+        coroutine_handle<> continuation;
+
+        AsyncTask get_return_object() {
+            return AsyncTask(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept {
+            return {};
+        }
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> handle) noexcept {
+                coroutine_handle<> next = handle.promise().continuation;
+                return next ? next : noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+        void return_value(T result) {
+            value = move(result);
+        }
+        void unhandled_exception() {
+            error = current_exception();
+        }
+    };
+
+    AsyncTask(AsyncTask&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    AsyncTask(const AsyncTask&) = delete;
+    ~AsyncTask() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().error)
+            rethrow_exception(handle.promise().error);
+        return move(*handle.promise().value);
+    }
+
+private:
+    explicit AsyncTask(coroutine_handle<promise_type> h) : handle(h) {}
+    coroutine_handle<promise_type> handle;
+};
+
+// A coroutine that starts immediately and frees itself when done; used for top-level pipelines.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return {};
+        }
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() {
+            terminate();
+        }
+    };
+};
+
+// Single-threaded event loop. Coroutines only ever resume on the thread calling run().
+class EventLoop {
+    int epollFd = -1;
+    int wakeFd = -1;
+    deque<coroutine_handle<>> ready;     // Loop thread only.
+    size_t pending = 0;                  // Offloaded operations not yet completed; loop thread only.
+    mutex completedLock;
+    vector<coroutine_handle<>> completed; // Filled by pool threads.
+
+public:
+    EventLoop() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    }
+    ~EventLoop() {
+        close(wakeFd);
+        close(epollFd);
+    }
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Queues a coroutine to resume on the next loop iteration (loop thread only).
+    void post(coroutine_handle<> handle) {
+        ready.push_back(handle);
+    }
+
+    // Called from any thread when offloaded work for a suspended coroutine has finished.
+    void complete(coroutine_handle<> handle) {
+        {
+            lock_guard<mutex> guard(completedLock);
+            completed.push_back(handle);
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    // Awaitable that runs work on the thread pool and resumes the coroutine on the loop.
+    struct Offload {
+        EventLoop& loop;
+        function<void()> work;
+        exception_ptr error;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        void await_suspend(coroutine_handle<> handle) {
+            loop.pending++;
+            EventLoop* target = &loop;
+            threadPool().submit([this, target, handle]() {
+                try {
+                    work();
+                } catch (...) {
+                    error = current_exception();
+                }
+                target->complete(handle); // The awaiter may be gone once this returns.
+            });
+        }
+        void await_resume() {
+            if (error)
+                rethrow_exception(error);
+        }
+    };
+
+    Offload offload(function<void()> work) {
+        return Offload{*this, move(work), nullptr};
+    }
+
+    // Runs until no coroutine is ready and nothing is in flight.
+    void run() {
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        epoll_event events[4];
+        for (;;) {
+            while (!ready.empty()) {
+                coroutine_handle<> handle = ready.front();
+                ready.pop_front();
+                handle.resume();
+            }
+            if (pending == 0)
+                break;
+            // Without pool workers the loop thread has to run the offloaded work itself.
+            if (threadPool().workerCount() == 0)
+                threadPool().runOne(seed);
+            if (epoll_wait(epollFd, events, 4, -1) < 0 && errno != EINTR)
+                break;
+            uint64_t count;
+            while (read(wakeFd, &count, sizeof(count)) > 0) {
+            }
+            lock_guard<mutex> guard(completedLock);
+            for (coroutine_handle<> handle : completed)
+                ready.push_back(handle);
+            pending -= completed.size();
+            completed.clear();
+        }
+    }
+};
+
+// A mutex for coroutines on one event loop: waiting suspends the coroutine, not the thread.
+class AsyncMutex {
+    EventLoop& loop;
+    bool locked = false;
+    deque<coroutine_handle<>> waiters;
+
+public:
+    explicit AsyncMutex(EventLoop& eventLoop) : loop(eventLoop) {}
+
+    struct LockAwaiter {
+        AsyncMutex& mutex;
+        bool await_ready() {
+            if (mutex.locked)
+                return false;
+            mutex.locked = true;
+            return true;
+        }
+        void await_suspend(coroutine_handle<> handle) {
+            mutex.waiters.push_back(handle);
+        }
+        void await_resume() {}
+    };
+
+    LockAwaiter lock() {
+        return LockAwaiter{*this};
+    }
+
+    // Hands the lock straight to the next waiter, if any.
+    void unlock() {
+        if (waiters.empty()) {
+            locked = false;
+        } else {
+            loop.post(waiters.front());
+            waiters.pop_front();
+        }
+    }
+};
+
+struct AsyncIntake {
+    EventLoop loop;
+    AsyncMutex writeLock{loop}; // Keeps ID assignment and report appends of different files apart.
+    NamesTable namesTable;
+    unique_ptr<NamePools> namePools; // Shared by all files, so no name is handed out twice.
+    string populationFilename;
+    OutputFormat format = CsvOutput;
+    string reviewFilename = "weightReview.txt";
+};
+
+// Function to take one arrivals file through read, parse, name and write.
+// The file is read in 1 MB preads. Each block's whole lines are parsed on the thread pool
+// while the next block is read, and stay a chunk of their own. Naming then runs on the
+// pool from the shared name pools, and IDs and the report append under the write lock.
+AsyncTask<size_t> intakeFileAsync(AsyncIntake& intake, string filename) {
+    bool json = filename.size() >= 6 && filename.compare(filename.size() - 6, 6, ".jsonl") == 0;
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        cerr << "Error opening file: " << filename << endl;
+        co_return 0;
+    }
+    const size_t blockSize = 1 << 20;
+    string block(blockSize, '\0'); // Block being read
+    string lines;                   // Bytes read but not parsed yet
+    string text;                    // Whole lines being parsed
+    off_t offset = 0;
+    ssize_t bytes = 0;
+    co_await intake.loop.offload([&]() { bytes = pread(fd, &block[0], blockSize, offset); });
+    ArrivingAnimals animals;
+    WeightAnomalyDetector detector; // Sees the blocks in file order.
+    while (bytes > 0 || !lines.empty()) {
+        bool more = bytes > 0;
+        if (more) {
+            lines.append(block, 0, bytes);
+            offset += bytes;
+        }
+        // Parse up to the last newline; the partial line after it waits for the next block.
+        size_t cut = more ? lines.rfind('\n') + 1 : lines.size();
+        text.assign(lines, 0, cut);
+        lines.erase(0, cut);
+        bytes = 0;
+        ArrivalsChunk chunk;
+        co_await intake.loop.offload([&]() {
+            runParallel(more ? 2 : 1, [&](size_t stage) {
+                if (stage == 0) {
+                    parseArrivalsChunk(text, json, chunk);
+                    flagWeightAnomalies(detector, chunk);
+                } else
+                    bytes = pread(fd, &block[0], blockSize, offset);
+            });
+        });
+        if (bytes < 0)
+            cerr << "Error reading file: " << filename << endl;
+        for (const auto& line : chunk.invalid)
+            cerr << "Invalid record: " << line << endl;
+        if (!chunk.flagged.empty()) {
+            // One append per block, so the review lines of files in flight do not interleave.
+            string review;
+            for (const auto& line : chunk.flagged)
+                review += line + "\n";
+            ofstream(intake.reviewFilename, ios::app | ios::binary) << review;
+        }
+        animals.arenas.push_back(move(chunk.arena));
+        animals.chunks.push_back(move(chunk.animals));
+    }
+    ::close(fd);
+
+    co_await intake.loop.offload([&]() { assignNamesParallel(animals, *intake.namePools); });
+
+    co_await intake.writeLock.lock();
+    co_await intake.loop.offload([&]() {
+        assignAnimalIds(intake.populationFilename, animals);
+        updateZooPopulation(intake.populationFilename, animals, intake.format);
+    });
+    intake.writeLock.unlock();
+    co_return animals.size();
+}
+
+DetachedTask runDetached(AsyncTask<size_t> task, string filename) {
+    size_t count = co_await move(task);
+    cout << filename << ": " << count << " animals\n";
+}
+
+// Subcommand: "async [--json] <arrivalsFile>...".
+// Processes several arrivals files concurrently from one event-loop thread; blocking reads,
+// parsing, naming and report writes run on the thread pool (see --threads).
+int runAsyncIntake(int argc, char* argv[]) {
+    AsyncIntake intake;
+    intake.populationFilename = "newAnimals.txt";
+    vector<string> files;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--json") {
+            intake.format = JsonLinesOutput;
+            intake.populationFilename = "newAnimals.jsonl";
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        cerr << "Usage: async [--json] <arrivalsFile>..." << endl;
+        return 1;
+    }
+    intake.namesTable = loadAnimalNames("animalNames.txt");
+    intake.namePools = make_unique<NamePools>(intake.namesTable, static_cast<uint64_t>(time(NULL)));
+    auto start = chrono::steady_clock::now();
+    for (const auto& file : files)
+        runDetached(intakeFileAsync(intake, file), file);
+    intake.loop.run();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    cout << files.size() << " files processed in " << elapsed.count() << " ms" << endl;
+    return 0;
+}
+#else
+int runAsyncIntake(int, char*[]) {
+    cerr << "The async intake pipeline needs a C++20 build on Linux (-std=c++20)." << endl;
+    return 1;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    // Thread pool options apply to every mode, so they are taken out of argv first:
+    // --threads N sets the number of threads for parallel stages (default: one per core),
+    // --pin-threads pins each pool worker to its own core,
+    // --numa binds workers to NUMA nodes and places intake chunks on them,
+    // --numa-nodes N does the same with N simulated nodes.
+    vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--threads" && i + 1 < argc) {
+            threadPoolConfig().threads = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+        } else if (option == "--pin-threads") {
+            threadPoolConfig().pinThreads = true;
+        } else if (option == "--numa") {
+            threadPoolConfig().numa = detectNumaTopology();
+        } else if (option == "--numa-nodes" && i + 1 < argc) {
+            threadPoolConfig().numa = simulatedNumaTopology(strtoull(argv[++i], nullptr, 10));
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    argc = static_cast<int>(args.size());
+    args.push_back(nullptr);
+    argv = args.data();
+
+    // Optional subcommands work on the existing population report instead of processing new arrivals.
+    if (argc > 1) {
+        string command = argv[1];
+        if (command == "topk")
+            return runTopK(argc, argv);
+        if (command == "stats")
+            return runStats(argc, argv);
+        if (command == "summary")
+            return runSummary(argc, argv);
+        if (command == "bench")
+            return runBench(argc, argv);
+        if (command == "lookup")
+            return runLookup(argc, argv);
+        if (command == "diff")
+            return runDiff(argc, argv);
+        if (command == "join")
+            return runJoin(argc, argv);
+        if (command == "async")
+            return runAsyncIntake(argc, argv);
+        if (command == "search")
+            return runSearch(argc, argv);
+        if (command == "selftest")
+            return runSelfTest(argc, argv);
+        if (command.compare(0, 2, "--") != 0) {
+            cerr << "Unknown command: " << command << endl;
+            return 1;
+        }
+    }
+
+    // Options for the default intake run.
+    OutputFormat outputFormat = CsvOutput;
+    string populationFilename = "newAnimals.txt";
+    string arrivalsFilename = "arrivingAnimals.txt";
+    string traceFilename;
+    bool directIO = false;
+    bool parallelNames = false;
+    bool deterministicNames = false;
+    uint64_t namingSeed = 0;
+    IntakeOptions intakeOptions; // Kernel hints for mapping the arrivals file (--intake-* options).
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--arrivals" && i + 1 < argc) {
+            // Read arrivals from another file; a ".jsonl" file is read as JSON Lines.
+            arrivalsFilename = argv[++i];
+        } else if (option == "--trace" && i + 1 < argc) {
+            // Record stage timings and write them as a Chrome trace JSON file.
+            traceFilename = argv[++i];
+            traceRegistry().enabled = true;
+        } else if (option == "--intake-populate") {
+            intakeOptions.populate = true;
+        } else if (option == "--intake-willneed") {
+            intakeOptions.willNeed = true;
+        } else if (option == "--intake-hugepages") {
+            intakeOptions.hugePages = true;
+        } else if (option == "--intake-no-sequential") {
+            intakeOptions.sequential = false;
+        } else if (option == "--direct-io") {
+            // Write the report with O_DIRECT, bypassing the page cache.
+            directIO = true;
+        } else if (option == "--parallel-names") {
+            // Name animals on all cores from shuffled pools; no name is handed out twice.
+            parallelNames = true;
+        } else if (option == "--seed" && i + 1 < argc) {
+            // Derive each name from the record and this seed instead of rand().
+            namingSeed = strtoull(argv[++i], nullptr, 10);
+            deterministicNames = true;
+        } else if (option == "--perf") {
+            // Measure each stage with hardware performance counters.
+            perfStages().enabled = true;
+        } else if (option == "--json") {
+            // Write the report as JSON Lines to its own file.
+            outputFormat = JsonLinesOutput;
+            populationFilename = "newAnimals.jsonl";
+        } else {
+            cerr << "Unknown option: " << option << endl;
+            return 1;
+        }
+    }
+
+    // Seed the random number generator with the current time.
+    srand(static_cast<unsigned int>(time(NULL)));
+    
+    // Each stage below is wrapped in measureStage() so --perf can attribute counters to it.
+    // Load animal names from the file "animalNames.txt".
+    NamesTable animalNames;
+    measureStage("load names", [&]() {
+        animalNames = loadAnimalNames("animalNames.txt");
+        return animalNames.size();
+    });
+    trackMemory(NamesMemory, heapBytes(animalNames));
+    
+    // Load arriving animal records from the file "arrivingAnimals.txt" (or the --arrivals file).
+    ArrivingAnimals arrivingAnimals;
+    measureStage("intake", [&]() {
+        arrivingAnimals = loadArrivingAnimals(arrivalsFilename, "weightReview.txt", intakeOptions);
+        return arrivingAnimals.size();
+    });
+    
+    trackMemory(IntakeMemory, heapBytes(arrivingAnimals));
+    
+    // Give each arriving animal its permanent ID.
+    measureStage("assign IDs", [&]() {
+        assignAnimalIds(populationFilename, arrivingAnimals);
+        return arrivingAnimals.size();
+    });
     
     // For each arriving animal, assign a random name based on its species.
-    for (auto &animal : arrivingAnimals) {
-        animal.name = assignName(animal.species, animalNamesMap);
-    }
+    measureStage("names", [&]() {
+        if (deterministicNames) {
+            assignNamesDeterministic(arrivingAnimals, animalNames, namingSeed);
+            return arrivingAnimals.size();
+        }
+        if (parallelNames) {
+            NamePools pools(animalNames, static_cast<uint64_t>(time(NULL)));
+            assignNamesParallel(arrivingAnimals, pools);
+            return arrivingAnimals.size();
+        }
+        TraceScope trace("name batch");
+        for (auto &animal : arrivingAnimals) {
+            animal.name = assignName(animal.species, animalNames);
+        }
+        return arrivingAnimals.size();
+    });
     
-    // Append the new animal records to the report file "newAnimals.txt".
-    updateZooPopulation("newAnimals.txt", arrivingAnimals);
+    // Append the new animal records to the report file ("newAnimals.txt" by default).
+    measureStage("write", [&]() {
+        updateZooPopulation(populationFilename, arrivingAnimals, outputFormat, directIO);
+        return arrivingAnimals.size();
+    });
     
     cout << "Zoo population updated successfully." << endl;
     
-    // Display the updated contents of the "newAnimals.txt" file.
-    ifstream populationFile("newAnimals.txt");
+    // Display the updated contents of the report file.
+    ifstream populationFile(populationFilename);
     if (!populationFile) {
         cerr << "Error opening newAnimals file." << endl;
         return 1;
@@ -210,5 +4898,13 @@ int main() {
     }
     populationFile.close();
     
+    if (!traceFilename.empty())
+        writeChromeTrace(traceFilename);
+    
+    // Report how much memory each part of the program used.
+    cout << "\n";
+    printMemoryReport(cout);
+    printPerfReport(cout);
+    
     return 0;
 }